@@ -1,28 +1,61 @@
 #include "Inteface.h"
 #include "SolverWrapper.h"
 #include <thread>
+#include <mutex>
 #include <cstring>
 
 using namespace Hroch;
 
 struct SolverHandle
 {
-	std::vector<ISolver *> mSolvers;
+	// cpus the pool threads are pinned to, null unless the numa option is set
+	std::unique_ptr<Utils::NumaTopology> mNuma;
+	// the threads of all the parallel work of the handle, num_threads times the larger of neighbour_threads and score_threads
+	std::unique_ptr<Utils::ThreadPool> mPool;
+	std::vector<std::unique_ptr<ISolver>> mSolvers;
 	solver_params mSolverParams{};
+	// chunk of rows Predict evaluates at once, reused between the calls
+	std::unique_ptr<DataSetF> mPredictF;
+	std::unique_ptr<DataSetD> mPredictD;
+	// PredictEnsemble computes the models of all the solvers together
+	std::unique_ptr<Computer::Machine<float, BATCH>> mEnsembleF;
+	std::unique_ptr<Computer::Machine<double, BATCH>> mEnsembleD;
+	std::vector<float> mEnsembleOutF;
+	std::vector<double> mEnsembleOutD;
+	// island model of the threads, of the precision searched in
+	std::unique_ptr<HillClimb::Migration<float>> mMigrationF;
+	std::unique_ptr<HillClimb::Migration<double>> mMigrationD;
+	// progress of the solvers of the current or last fit, FitCancel sets mCancel
+	std::unique_ptr<HillClimb::FitProgress[]> mProgress;
+	std::atomic<bool> mCancel{false};
+	// set while a fit of the handle runs, BeginFit claims it and the fit clears it when it returns
+	std::atomic<bool> mFitRunning{false};
+	// fit started by FitAsync32/64, mFitResult is its return value once mFitRunning is cleared,
+	// mFitThread is started and joined under mFitMutex
+	std::mutex mFitMutex;
+	std::thread mFitThread;
+	int mFitResult{0};
 };
 
+// inputs and outputs of a predicted chunk fit in about this many bytes
+constexpr static size_t PREDICT_CHUNK_BYTES = 1 << 20;
+
+// Copies the columns of X, with capacity values apart, y and sw into the buffers of data and sampleWeight
+// that don't wrap them already, then pads the last batch with random rows
 template <typename T>
-void FillDataset(Utils::Dataset<T, BATCH> &data, SymbolicRegression::Utils::BatchVector<T, BATCH> *sampleWeight, const T *X, const T *y, const T *sw, unsigned int rows, unsigned int xcols, uint64_t random_state) noexcept
+void FillDataset(Utils::Dataset<T, BATCH> &data, SymbolicRegression::Utils::BatchVector<T, BATCH> *sampleWeight, const T *X, const T *y, const T *sw, unsigned int rows, size_t capacity, unsigned int xcols, uint64_t random_state) noexcept
 {
 	auto newSize = (rows / BATCH) * BATCH;
 	if (newSize < rows)
 		newSize += BATCH;
 	for (unsigned int i = 0; i < xcols; i++)
 	{
-		std::memcpy(data.DataX(i), &X[i * rows], (size_t)rows * sizeof(T));
+		if (data.DataX(i) != &X[i * capacity])
+			std::memcpy(data.DataX(i), &X[i * capacity], (size_t)rows * sizeof(T));
 	}
-	std::memcpy(data.DataY(), y, (size_t)rows * sizeof(T));
-	if (sw && sampleWeight)
+	if (data.DataY() != y)
+		std::memcpy(data.DataY(), y, (size_t)rows * sizeof(T));
+	if (sw && sampleWeight && sampleWeight->GetData() != sw)
 	{
 		std::memcpy(sampleWeight->GetData(), sw, (size_t)rows * sizeof(T));
 	}
@@ -42,12 +75,21 @@ void FillDataset(Utils::Dataset<T, BATCH> &data, SymbolicRegression::Utils::Batc
 			data.DataY()[j] = data.DataY()[sampleId];
 			if (sw && sampleWeight)
 			{
-				sampleWeight->GetData()[j] = sw[sampleId];
+				sampleWeight->GetData()[j] = sampleWeight->GetData()[sampleId];
 			}
 		}
 	}
 }
 
+// A caller buffer is used in place when it is aligned for the batches and holds them whole, either already
+// padded or with the capacity for the padding when it may be written
+template <typename T>
+bool CanWrap(const T *data, unsigned int rows, size_t capacity, bool writable) noexcept
+{
+	const auto padded = SymbolicRegression::Utils::BatchVector<T, BATCH>::BatchCount(rows) * BATCH;
+	return SymbolicRegression::Utils::BatchVector<T, BATCH>::IsWrappable(data) && capacity >= padded && (writable || padded == rows);
+}
+
 std::vector<std::string> split(const std::string &target, char c)
 {
 	std::string temp;
@@ -190,32 +232,108 @@ SymbolicRegression::FitParams GetFitParams(const fit_params &fp, uint32_t xcols)
 	};
 }
 
+// copy of the fit data of a NUMA node
+template <typename T>
+struct Replica
+{
+	std::unique_ptr<SymbolicRegression::Utils::Dataset<T, BATCH>> mData;
+	std::unique_ptr<SymbolicRegression::Utils::BatchVector<T, BATCH>> mSampleWeight;
+};
+
+// Copies data and sw once per NUMA node other than home, each copy allocated and written by the pool
+// worker of its node so the pages are local to the solvers running there. The solvers on home read data
+// itself. None on a single node, all the threads share data.
+template <typename U, typename T>
+std::vector<Replica<U>> Replicate(const SolverHandle &solver,
+								  const SymbolicRegression::Utils::Dataset<T, BATCH> &data,
+								  const SymbolicRegression::Utils::BatchVector<T, BATCH> *sw,
+								  size_t home)
+{
+	if (!solver.mNuma || solver.mNuma->Nodes() < 2)
+		return {};
+	const auto cs = SymbolicRegression::CodeSettings{solver.mSolverParams.input_size, solver.mSolverParams.const_size, solver.mSolverParams.min_code_size, solver.mSolverParams.max_code_size};
+	std::vector<Replica<U>> replicas(solver.mNuma->Nodes());
+	solver.mPool->ForEachNode([&](size_t node) noexcept
+							  {
+		if (node == home)
+			return;
+		auto &replica = replicas[node];
+		replica.mData = std::make_unique<SymbolicRegression::Utils::Dataset<U, BATCH>>(data.Size(), cs);
+		replica.mData->CopyFrom(data);
+		if (sw)
+		{
+			replica.mSampleWeight = std::make_unique<SymbolicRegression::Utils::BatchVector<U, BATCH>>(data.Size());
+			std::copy(sw->GetData(), sw->GetData() + data.BatchCount() * BATCH, replica.mSampleWeight->GetData());
+		} });
+	return replicas;
+}
+
+// the replica of the node of the calling thread, data and sw on home and without replicas
+template <typename T>
+auto Local(const SolverHandle &solver,
+		   const std::vector<Replica<T>> &replicas,
+		   const SymbolicRegression::Utils::Dataset<T, BATCH> &data,
+		   const SymbolicRegression::Utils::BatchVector<T, BATCH> *sw) noexcept
+{
+	if (replicas.empty())
+		return std::make_pair(&data, sw);
+	const auto &replica = replicas[std::min(solver.mPool->CurrentNode(), replicas.size() - 1)];
+	if (!replica.mData)
+		return std::make_pair(&data, sw);
+	return std::make_pair(static_cast<const SymbolicRegression::Utils::Dataset<T, BATCH> *>(replica.mData.get()),
+						  static_cast<const SymbolicRegression::Utils::BatchVector<T, BATCH> *>(sw ? replica.mSampleWeight.get() : nullptr));
+}
+
 template <typename T>
 int FitData(SolverHandle &solver,
 			const SymbolicRegression::Utils::Dataset<T, BATCH> &data,
 			const SymbolicRegression::FitParams &fp,
 			SymbolicRegression::Utils::BatchVector<T, BATCH> *sw)
 {
+	// the calling thread runs solver 0 and steals the others, Local picks their replica once, so it stays on its node
+	const auto home = solver.mPool->CurrentNode();
+	const Utils::ScopedPin pin{solver.mNuma ? solver.mNuma->Cpus(home) : std::vector<uint32_t>{}};
+	const auto replicas = Replicate<T>(solver, data, sw, home);
 	if (fp.mVerbose > 1)
 		printf("run fit task...\n");
-	auto thread_func = [&](size_t idx)
-	{
-		solver.mSolvers[idx]->Fit(data, fp, sw);
-	};
+	solver.mPool->ParallelFor(solver.mSolvers.size(), [&](size_t idx) noexcept
+							  {
+		const auto [local, localSw] = Local(solver, replicas, data, sw);
+		solver.mSolvers[idx]->Fit(*local, fp, localSw); });
+	if (fp.mVerbose > 1)
+		printf("%zu threads done..\n", solver.mSolvers.size());
+	return 0;
+}
 
-	std::vector<std::thread> threads;
-	for (size_t i = 0; i < solver.mSolvers.size(); i++)
+// float copy of a filled dataset for the float32 search of the mixed precision
+void FillSearchDataset(DataSetF &search, SampleWeightF *searchSw, const DataSetD &data, const SampleWeightD *sw) noexcept
+{
+	search.CopyFrom(data);
+	if (sw && searchSw)
 	{
-		threads.emplace_back(std::thread(thread_func, (size_t)i));
+		std::copy(sw->GetData(), sw->GetData() + data.BatchCount() * BATCH, searchSw->GetData());
 	}
+}
+
+int FitMixed(SolverHandle &solver, const DataSetD &data, const SymbolicRegression::FitParams &fp, SampleWeightD *sw)
+{
+	const auto cs = SymbolicRegression::CodeSettings{solver.mSolverParams.input_size, solver.mSolverParams.const_size, solver.mSolverParams.min_code_size, solver.mSolverParams.max_code_size};
+	DataSetF search{data.Size(), cs};
+	SampleWeightF searchSw{data.Size()};
+	FillSearchDataset(search, &searchSw, data, sw);
 
-	for (auto &th : threads)
-	{
-		if (th.joinable())
-			th.join();
-	}
 	if (fp.mVerbose > 1)
-		printf("%zu threads done..\n", threads.size());
+		printf("run mixed precision fit task...\n");
+	// search and data serve the node of the calling thread, where they were written, it stays there as in FitData
+	const auto home = solver.mPool->CurrentNode();
+	const Utils::ScopedPin pin{solver.mNuma ? solver.mNuma->Cpus(home) : std::vector<uint32_t>{}};
+	const auto searchReplicas = Replicate<float>(solver, data, sw, home);
+	const auto replicas = Replicate<double>(solver, data, sw, home);
+	solver.mPool->ParallelFor(solver.mSolvers.size(), [&](size_t idx) noexcept
+							  {
+		const auto [localSearch, localSearchSw] = Local(solver, searchReplicas, search, sw ? &searchSw : nullptr);
+		const auto [local, localSw] = Local(solver, replicas, data, sw);
+		solver.mSolvers[idx]->Fit(*localSearch, *local, fp, localSearchSw, localSw); });
 	return 0;
 }
 
@@ -231,10 +349,13 @@ auto GetFeatProbsFromXicor(FitParams& fp, const SymbolicRegression::Utils::Datas
 	}
 }
 
+// X holds the columns capacity values apart, X, y and sw are read in place when CanWrap allows it,
+// writable X columns get the padding rows written past rows. y and sw hold rows values only, they are
+// never written.
 template <typename T>
-int FitData(SolverHandle &solver, const T *X, const T *y, uint32_t rows, uint32_t xcols, const fit_params &params, const T *sw)
+int FitData(SolverHandle &solver, const T *X, const T *y, uint32_t rows, size_t capacity, uint32_t xcols, const fit_params &params, const T *sw, bool writable)
 {
-	if (!X || !y || xcols < 1 || xcols != solver.mSolverParams.input_size || rows < 4)
+	if (!X || !y || xcols < 1 || xcols != solver.mSolverParams.input_size || rows < 4 || capacity < rows)
 	{
 		if (params.verbose > 0)
 		{
@@ -245,114 +366,502 @@ int FitData(SolverHandle &solver, const T *X, const T *y, uint32_t rows, uint32_
 
 	auto fp = GetFitParams(params, xcols);
 	const auto cs = SymbolicRegression::CodeSettings{solver.mSolverParams.input_size, solver.mSolverParams.const_size, solver.mSolverParams.min_code_size, solver.mSolverParams.max_code_size};
-	SymbolicRegression::Utils::Dataset<T, BATCH> data{(size_t)rows, cs};
 
-	SymbolicRegression::Utils::BatchVector<T, BATCH> sampleWeight{(size_t)rows};
-	FillDataset(data, &sampleWeight, X, y, sw, rows, xcols, solver.mSolverParams.random_state);
+	// the search never writes the inputs, the buffers of the read only entry points are wrapped only when
+	// no padding is needed
+	const auto wrapX = CanWrap(X, rows, capacity, writable) && (capacity * sizeof(T)) % 32 == 0;
+	std::vector<T *> columns(xcols, nullptr);
+	for (uint32_t i = 0; i < xcols && wrapX; i++)
+	{
+		columns[i] = const_cast<T *>(&X[i * capacity]);
+	}
+	SymbolicRegression::Utils::Dataset<T, BATCH> data{(size_t)rows, cs, columns.data(), CanWrap(y, rows, rows, false) ? const_cast<T *>(y) : nullptr};
+
+	std::unique_ptr<SymbolicRegression::Utils::BatchVector<T, BATCH>> sampleWeight;
+	if (CanWrap(sw, rows, rows, false))
+		sampleWeight = std::make_unique<SymbolicRegression::Utils::BatchVector<T, BATCH>>(const_cast<T *>(sw), (size_t)rows);
+	else
+		sampleWeight = std::make_unique<SymbolicRegression::Utils::BatchVector<T, BATCH>>((size_t)(sw ? rows : 0));
+	FillDataset(data, sampleWeight.get(), X, y, sw, rows, capacity, xcols, solver.mSolverParams.random_state);
+	if (solver.mSolverParams.storage <= static_cast<unsigned int>(Utils::Storage::Bf16))
+		data.Compact(static_cast<Utils::Storage>(solver.mSolverParams.storage));
 
 	if (fp.mFeatProbs.empty())
 	{
 		GetFeatProbsFromXicor(fp, data, rows);
 	}
 
-	return FitData(solver, data, fp, sw ? &sampleWeight : nullptr);
+	if constexpr (std::is_same_v<T, double>)
+	{
+		if (solver.mSolverParams.precision == 3)
+			return FitMixed(solver, data, fp, sw ? sampleWeight.get() : nullptr);
+	}
+	return FitData(solver, data, fp, sw ? sampleWeight.get() : nullptr);
+}
+
+template <typename T>
+auto &PredictChunk(SolverHandle &solver) noexcept
+{
+	if constexpr (std::is_same_v<T, float>)
+		return solver.mPredictF;
+	else
+		return solver.mPredictD;
+}
+
+template <typename T>
+auto &EnsembleMachine(SolverHandle &solver) noexcept
+{
+	if constexpr (std::is_same_v<T, float>)
+		return solver.mEnsembleF;
+	else
+		return solver.mEnsembleD;
+}
+
+template <typename T>
+auto &EnsembleOutput(SolverHandle &solver) noexcept
+{
+	if constexpr (std::is_same_v<T, float>)
+		return solver.mEnsembleOutF;
+	else
+		return solver.mEnsembleOutD;
+}
+
+// Rows of a chunk, each of the threads gets about PREDICT_CHUNK_BYTES of the xcols inputs and the outputs.
+// The handle's chunk dataset grows to hold them.
+template <typename T>
+auto &PrepareChunk(SolverHandle &solver, unsigned int rows, unsigned int xcols, size_t outputs, size_t threads, size_t &chunkRows)
+{
+	const auto chunkBatches = std::max<size_t>(PREDICT_CHUNK_BYTES / ((xcols + outputs) * sizeof(T) * BATCH), 1) * threads;
+	chunkRows = std::min(chunkBatches, SymbolicRegression::Utils::BatchVector<T, BATCH>::BatchCount(rows)) * BATCH;
+
+	auto &chunk = PredictChunk<T>(solver);
+	if (!chunk || chunk->Size() < chunkRows)
+	{
+		const auto cs = SymbolicRegression::CodeSettings{solver.mSolverParams.input_size, solver.mSolverParams.const_size, solver.mSolverParams.min_code_size, solver.mSolverParams.max_code_size};
+		chunk = std::make_unique<SymbolicRegression::Utils::Dataset<T, BATCH>>(chunkRows, cs);
+	}
+	return *chunk;
+}
+
+// copies count rows of X from start to the chunk, returns its batch count
+template <typename T>
+size_t FillChunk(SymbolicRegression::Utils::Dataset<T, BATCH> &chunk, const T *X, unsigned int rows, unsigned int xcols, size_t start, size_t count) noexcept
+{
+	const auto batchCount = SymbolicRegression::Utils::BatchVector<T, BATCH>::BatchCount(count);
+	for (unsigned int i = 0; i < xcols; i++)
+	{
+		auto *x = chunk.DataX(i);
+		std::memcpy(x, &X[i * (size_t)rows + start], count * sizeof(T));
+		// the rest of the last batch repeats a row, its predictions are dropped
+		std::fill(x + count, x + batchCount * BATCH, x[0]);
+	}
+	return batchCount;
+}
+
+size_t PredictThreads(const SolverHandle &solver, unsigned int numThreads) noexcept
+{
+	return std::min<size_t>(numThreads ? numThreads : solver.mSolverParams.num_threads, solver.mPool->Size());
 }
 
+// solver of the best model by the score on all data, then on the sample while a fit has not rescored them yet,
+// nullptr before a fit published any model
+ISolver *BestSolver(const SolverHandle &solver) noexcept
+{
+	auto bestScores = std::make_pair(std::numeric_limits<double>::max(), std::numeric_limits<double>::max());
+	ISolver *best = nullptr;
+	for (const auto &s : solver.mSolvers)
+	{
+		if (!s->Published())
+			continue;
+		const auto scores = s->GetBestScores();
+		if (scores < bestScores)
+		{
+			best = s.get();
+			bestScores = scores;
+		}
+	}
+	return best;
+}
+
+// The rows are predicted chunk by chunk, each one copied to the handle's chunk dataset and its predictions
+// copied to y, the memory used does not grow with the rows
 template <typename T>
 int Predict(SolverHandle &solver, const T *X, T *y, unsigned int rows, unsigned int xcols, [[maybe_unused]] const predict_params *params)
 {
+	if (!X || !y || xcols != solver.mSolverParams.input_size)
+		return 1;
+
 	ISolver *ps = nullptr;
 
 	if (params->id != (uint32_t)-1)
 	{
-		ps = solver.mSolvers[params->id / solver.mSolverParams.pop_size];
+		const auto idx = params->id / solver.mSolverParams.pop_size;
+		if (idx < solver.mSolvers.size() && solver.mSolvers[idx]->Published())
+			ps = solver.mSolvers[idx].get();
 	}
 	else
 	{
-		auto bestScore = std::numeric_limits<double>::max();
-		for (auto s : solver.mSolvers)
+		ps = BestSolver(solver);
+	}
+
+	if (!ps)
+		return 1;
+
+	const auto threads = PredictThreads(solver, params->num_threads);
+	size_t chunkRows;
+	auto &chunk = PrepareChunk<T>(solver, rows, xcols, 1, threads, chunkRows);
+
+	for (size_t start = 0; start < rows; start += chunkRows)
+	{
+		const auto count = std::min<size_t>(chunkRows, rows - start);
+		const auto batchCount = FillChunk(chunk, X, rows, xcols, start, count);
+
+		if (params->id != (uint32_t)-1)
+			ps->Predict(chunk, solver.mSolverParams.transformation, params->id % solver.mSolverParams.pop_size, (T)solver.mSolverParams.clip_min, (T)solver.mSolverParams.clip_max, batchCount, threads);
+		else
+			ps->Predict(chunk, solver.mSolverParams.transformation, (T)solver.mSolverParams.clip_min, (T)solver.mSolverParams.clip_max, batchCount, threads);
+
+		std::memcpy(&y[start], chunk.DataY(), count * sizeof(T));
+	}
+	return 0;
+}
+
+// ids of the models, the given ones or the top_k by the score on all data, then on the sample
+std::vector<unsigned long long> EnsembleIds(const SolverHandle &solver, const ensemble_params &params)
+{
+	const auto popSize = (unsigned long long)solver.mSolverParams.pop_size;
+	if (params.ids)
+		return {params.ids, params.ids + params.ids_count};
+
+	std::vector<std::pair<std::pair<double, double>, unsigned long long>> ranked;
+	for (size_t t = 0; t < solver.mSolvers.size(); t++)
+	{
+		for (size_t i = 0; i < popSize; i++)
 		{
-			if (s->Score() < bestScore)
-			{
-				ps = s;
-				bestScore = s->Score();
-			}
+			ranked.push_back({solver.mSolvers[t]->GetScores(i), t * popSize + i});
 		}
 	}
+	const auto k = std::min<size_t>(params.top_k, ranked.size());
+	std::partial_sort(ranked.begin(), ranked.begin() + k, ranked.end());
 
-	if (!ps)
+	std::vector<unsigned long long> ids(k);
+	for (size_t i = 0; i < k; i++)
+	{
+		ids[i] = ranked[i].second;
+	}
+	return ids;
+}
+
+// All the models are computed on a chunk before the next one, see Machine::Compute of several codes
+template <typename T>
+int PredictEnsemble(SolverHandle &solver, const T *X, T *y, unsigned int rows, unsigned int xcols, const ensemble_params *params)
+{
+	if (!X || !y || !params || xcols != solver.mSolverParams.input_size)
 		return 1;
 
+	const auto ids = EnsembleIds(solver, *params);
+	if (ids.empty())
+		return 1;
+
+	const auto popSize = (unsigned long long)solver.mSolverParams.pop_size;
 	const auto cs = SymbolicRegression::CodeSettings{solver.mSolverParams.input_size, solver.mSolverParams.const_size, solver.mSolverParams.min_code_size, solver.mSolverParams.max_code_size};
-	SymbolicRegression::Utils::Dataset<T, BATCH> data{(size_t)rows, cs};
-	FillDataset(data, static_cast<SymbolicRegression::Utils::BatchVector<T, BATCH> *>(nullptr), X, y, static_cast<const T *>(nullptr), rows, xcols, solver.mSolverParams.random_state);
+	// copies of the models, a running fit goes on changing them
+	std::vector<SymbolicRegression::EvaluatedCode<T>> models(ids.size(), SymbolicRegression::EvaluatedCode<T>{cs});
+	std::vector<const Computer::Code<T> *> codes(ids.size(), nullptr);
+	for (size_t k = 0; k < ids.size(); k++)
+	{
+		if (ids[k] / popSize >= solver.mSolvers.size())
+			return 1;
+		if (!solver.mSolvers[ids[k] / popSize]->ReadModel(ids[k] % popSize, models[k]))
+			return 1;
+		codes[k] = &models[k].mCode;
+	}
 
-	if (params->id != (uint32_t)-1)
-		ps->Predict(data, solver.mSolverParams.transformation, params->id % solver.mSolverParams.pop_size, (T)solver.mSolverParams.clip_min, (T)solver.mSolverParams.clip_max);
-	else
-		ps->Predict(data, solver.mSolverParams.transformation, (T)solver.mSolverParams.clip_min, (T)solver.mSolverParams.clip_max);
+	auto weightSum = 0.0;
+	for (size_t k = 0; k < ids.size(); k++)
+	{
+		weightSum += params->weights ? params->weights[k] : 1.0;
+	}
+	if (params->average && weightSum == 0.0)
+		return 1;
+
+	const auto threads = PredictThreads(solver, params->num_threads);
+	size_t chunkRows;
+	auto &chunk = PrepareChunk<T>(solver, rows, xcols, ids.size(), threads, chunkRows);
 
-	memcpy(y, data.DataY(), rows * sizeof(T));
+	auto &machine = EnsembleMachine<T>(solver);
+	if (!machine)
+	{
+		machine = std::make_unique<Computer::Machine<T, BATCH>>(cs, Utils::SelectIsa(static_cast<Utils::Isa>(solver.mSolverParams.isa)));
+		machine->SetThreadPool(solver.mPool.get());
+	}
+	auto &out = EnsembleOutput<T>(solver);
+	out.resize(ids.size() * chunkRows);
+	std::vector<T *> outputs(ids.size());
+	for (size_t k = 0; k < ids.size(); k++)
+	{
+		outputs[k] = &out[k * chunkRows];
+	}
+
+	for (size_t start = 0; start < rows; start += chunkRows)
+	{
+		const auto count = std::min<size_t>(chunkRows, rows - start);
+		const auto batchCount = FillChunk(chunk, X, rows, xcols, start, count);
+		machine->Compute(chunk, codes, outputs, solver.mSolverParams.transformation, (T)solver.mSolverParams.clip_min, (T)solver.mSolverParams.clip_max, batchCount, threads);
+
+		if (!params->average)
+		{
+			for (size_t k = 0; k < ids.size(); k++)
+			{
+				std::memcpy(&y[k * rows + start], outputs[k], count * sizeof(T));
+			}
+			continue;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			auto sum = 0.0;
+			for (size_t k = 0; k < ids.size(); k++)
+			{
+				sum += (params->weights ? params->weights[k] : 1.0) * outputs[k][i];
+			}
+			y[start + i] = (T)(sum / weightSum);
+		}
+	}
 	return 0;
 }
 
+// Copy of the first size bytes of params, the fields past them zeroed. A caller built against an older header
+// passes a smaller struct, the fields appended since then are left at 0, their default.
+template <typename P>
+P Sized(const P *params, size_t size) noexcept
+{
+	P sized{};
+	std::memcpy(&sized, params, std::min(size, sizeof(P)));
+	return sized;
+}
+
+// sizes of solver_params and predict_params in version 1.4.9, the entry points without a size read these
+constexpr size_t SOLVER_PARAMS_1_4_9 = offsetof(solver_params, isa);
+constexpr size_t PREDICT_PARAMS_1_4_9 = offsetof(predict_params, num_threads);
+
 void *CreateSolver(const solver_params *params)
 {
+	return CreateSolverEx(params, SOLVER_PARAMS_1_4_9);
+}
+
+void *CreateSolverEx(const solver_params *callerParams, unsigned int params_size)
+{
+	const auto sized = Sized(callerParams, params_size);
+	const auto params = &sized;
 	const auto handle = new SolverHandle{};
 	handle->mSolverParams = *params;
 	auto cfg = GetConfig(*params);
+	cfg.mIsa = Utils::SelectIsa(static_cast<Utils::Isa>(params->isa));
+	cfg.mEvalCacheSize = params->eval_cache_mb > 0 ? (size_t)params->eval_cache_mb << 20 : 0;
+	cfg.mBatchNeighbours = params->batch_neighbours != 0;
+	cfg.mRefineIterLimit = params->refine_iter_limit;
+	cfg.mMigrationInterval = params->migration_interval;
+	cfg.mMigrationTopology = params->migration_topology;
+	if (params->numa)
+		handle->mNuma = std::make_unique<Utils::NumaTopology>();
+	cfg.mNeighbourThreads = std::max(params->neighbour_threads, 1u);
+	cfg.mScoreThreads = std::max(params->score_threads, 1u);
+	handle->mPool = std::make_unique<Utils::ThreadPool>((size_t)params->num_threads * std::max(cfg.mNeighbourThreads, cfg.mScoreThreads), handle->mNuma.get());
 	handle->mSolvers.resize(params->num_threads);
+	if (params->migration_interval && params->num_threads > 1)
+	{
+		const auto topology = static_cast<HillClimb::Topology>(params->migration_topology);
+		if (params->precision == 2)
+			handle->mMigrationD = std::make_unique<HillClimb::Migration<double>>(params->num_threads, cfg.mCodeSettings, topology);
+		else
+			handle->mMigrationF = std::make_unique<HillClimb::Migration<float>>(params->num_threads, cfg.mCodeSettings, topology);
+	}
+	handle->mProgress = std::make_unique<HillClimb::FitProgress[]>(handle->mSolvers.size());
 	SymbolicRegression::Utils::RandomEngine re;
 	re.Seed(params->random_state);
-	for (auto &s : handle->mSolvers)
+	for (size_t i = 0; i < handle->mSolvers.size(); i++)
 	{
+		auto &s = handle->mSolvers[i];
 		cfg.mRandomSeed = re.RandU64();
-		s = SolverFactory::Create(cfg, params->precision == 1 ? EDataType::F32 : EDataType::F64);
+		s.reset(SolverFactory::Create(cfg, params->precision == 1 ? EDataType::F32 : (params->precision == 3 ? EDataType::Mixed : EDataType::F64)));
+		s->SetThreadPool(handle->mPool.get());
+		s->SetProgress(&handle->mProgress[i], &handle->mCancel);
+		s->SetMigration(handle->mMigrationF.get(), i);
+		s->SetMigration(handle->mMigrationD.get(), i);
 	}
 	return (void *)handle;
 }
 
 void DeleteSolver(void *hsolver)
 {
-	delete (SolverHandle *)hsolver;
+	auto solver = (SolverHandle *)hsolver;
+	solver->mCancel.store(true, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(solver->mFitMutex);
+		if (solver->mFitThread.joinable())
+			solver->mFitThread.join();
+	}
+	delete solver;
+}
+
+// Claims the handle for a fit, joins a finished asynchronous fit and clears the progress and the cancel request
+// of the last fit, false while another fit is running. EndFit releases the handle
+bool BeginFit(SolverHandle &solver) noexcept
+{
+	bool running = false;
+	if (!solver.mFitRunning.compare_exchange_strong(running, true, std::memory_order_acq_rel))
+		return false;
+	{
+		std::lock_guard<std::mutex> lock(solver.mFitMutex);
+		if (solver.mFitThread.joinable())
+			solver.mFitThread.join();
+	}
+	solver.mCancel.store(false, std::memory_order_relaxed);
+	for (size_t i = 0; i < solver.mSolvers.size(); i++)
+	{
+		solver.mProgress[i].Reset();
+	}
+	return true;
+}
+
+int EndFit(SolverHandle &solver, const int result) noexcept
+{
+	solver.mFitRunning.store(false, std::memory_order_release);
+	return result;
+}
+
+template <typename T>
+int FitAsync(SolverHandle &solver, const T *X, const T *y, unsigned int rows, unsigned int xcols, const fit_params *params, const T *sw, unsigned int sw_len)
+{
+	if (!BeginFit(solver))
+		return 1;
+	// the next BeginFit can claim the handle as soon as the thread ends, it joins the thread once it is stored
+	std::lock_guard<std::mutex> lock(solver.mFitMutex);
+	solver.mFitThread = std::thread([&solver, X, y, rows, xcols, fp = *params, sw = sw_len == rows ? sw : nullptr]() noexcept
+									{
+		solver.mFitResult = FitData(solver, X, y, rows, (size_t)rows, xcols, fp, sw, false);
+		EndFit(solver, solver.mFitResult); });
+	return 0;
 }
 
 int FitData32(void *hsolver, const float *X, const float *y, unsigned int rows, unsigned int xcols, const fit_params *params, const float *sw, unsigned int sw_len)
 {
 	SolverHandle *solver = (SolverHandle *)hsolver;
-	if (solver->mSolverParams.precision != 1)
+	if (solver->mSolverParams.precision != 1 || !BeginFit(*solver))
 		return 1;
 
-	return FitData(*solver, X, y, rows, xcols, *params, sw_len == rows ? sw : nullptr);
+	return EndFit(*solver, FitData(*solver, X, y, rows, (size_t)rows, xcols, *params, sw_len == rows ? sw : nullptr, false));
 }
 
 int FitData64(void *hsolver, const double *X, const double *y, unsigned int rows, unsigned int xcols, const fit_params *params, const double *sw, unsigned int sw_len)
 {
 	SolverHandle *solver = (SolverHandle *)hsolver;
-	if (solver->mSolverParams.precision != 2)
+	if ((solver->mSolverParams.precision != 2 && solver->mSolverParams.precision != 3) || !BeginFit(*solver))
+		return 1;
+
+	return EndFit(*solver, FitData(*solver, X, y, rows, (size_t)rows, xcols, *params, sw_len == rows ? sw : nullptr, false));
+}
+
+int FitAsync32(void *hsolver, const float *X, const float *y, unsigned int rows, unsigned int xcols, const fit_params *params, const float *sw, unsigned int sw_len)
+{
+	SolverHandle *solver = (SolverHandle *)hsolver;
+	if (solver->mSolverParams.precision != 1)
+		return 1;
+
+	return FitAsync(*solver, X, y, rows, xcols, params, sw, sw_len);
+}
+
+int FitAsync64(void *hsolver, const double *X, const double *y, unsigned int rows, unsigned int xcols, const fit_params *params, const double *sw, unsigned int sw_len)
+{
+	SolverHandle *solver = (SolverHandle *)hsolver;
+	if (solver->mSolverParams.precision != 2 && solver->mSolverParams.precision != 3)
 		return 1;
 
-	return FitData(*solver, X, y, rows, xcols, *params, sw_len == rows ? sw : nullptr);
+	return FitAsync(*solver, X, y, rows, xcols, params, sw, sw_len);
 }
 
-int Predict32(void *hsolver, const float *X, float *y, unsigned int rows, unsigned int xcols, [[maybe_unused]] const predict_params *params)
+int FitPoll(void *hsolver, fit_status *status, fit_progress *progress, unsigned int progress_count)
+{
+	auto solver = (SolverHandle *)hsolver;
+	if (!status)
+		return 1;
+
+	const auto running = solver->mFitRunning.load(std::memory_order_acquire);
+	status->running = running;
+	status->result = running ? 0 : solver->mFitResult;
+	status->solvers = (unsigned int)solver->mSolvers.size();
+	status->iterations = 0;
+	status->best_score = LARGE_FLOAT;
+	for (size_t i = 0; i < solver->mSolvers.size(); i++)
+	{
+		const auto iterations = solver->mProgress[i].mIterations.load(std::memory_order_relaxed);
+		const auto score = solver->mProgress[i].mScore.load(std::memory_order_relaxed);
+		status->iterations += iterations;
+		status->best_score = std::min(status->best_score, score);
+		if (progress && i < progress_count)
+		{
+			progress[i].iterations = iterations;
+			progress[i].best_score = score;
+		}
+	}
+	return 0;
+}
+
+int FitCancel(void *hsolver)
+{
+	auto solver = (SolverHandle *)hsolver;
+	solver->mCancel.store(true, std::memory_order_relaxed);
+	return 0;
+}
+
+int FitData32Ex(void *hsolver, float *X, float *y, unsigned int rows, unsigned int capacity, unsigned int xcols, const fit_params *params, float *sw, unsigned int sw_len)
+{
+	SolverHandle *solver = (SolverHandle *)hsolver;
+	if (solver->mSolverParams.precision != 1 || !BeginFit(*solver))
+		return 1;
+
+	return EndFit(*solver, FitData(*solver, X, y, rows, (size_t)capacity, xcols, *params, sw_len == rows ? sw : nullptr, true));
+}
+
+int FitData64Ex(void *hsolver, double *X, double *y, unsigned int rows, unsigned int capacity, unsigned int xcols, const fit_params *params, double *sw, unsigned int sw_len)
+{
+	SolverHandle *solver = (SolverHandle *)hsolver;
+	if ((solver->mSolverParams.precision != 2 && solver->mSolverParams.precision != 3) || !BeginFit(*solver))
+		return 1;
+
+	return EndFit(*solver, FitData(*solver, X, y, rows, (size_t)capacity, xcols, *params, sw_len == rows ? sw : nullptr, true));
+}
+
+int Predict32(void *hsolver, const float *X, float *y, unsigned int rows, unsigned int xcols, const predict_params *params)
+{
+	return Predict32Ex(hsolver, X, y, rows, xcols, params, PREDICT_PARAMS_1_4_9);
+}
+
+int Predict32Ex(void *hsolver, const float *X, float *y, unsigned int rows, unsigned int xcols, const predict_params *params, unsigned int params_size)
 {
 	auto solver = (SolverHandle *)hsolver;
 
 	if (solver->mSolverParams.precision != 1)
 		return 1;
 
-	return Predict(*solver, X, y, rows, xcols, params);
+	const auto sized = Sized(params, params_size);
+	return Predict(*solver, X, y, rows, xcols, &sized);
+}
+
+int Predict64(void *hsolver, const double *X, double *y, unsigned int rows, unsigned int xcols, const predict_params *params)
+{
+	return Predict64Ex(hsolver, X, y, rows, xcols, params, PREDICT_PARAMS_1_4_9);
 }
 
-int Predict64(void *hsolver, const double *X, double *y, unsigned int rows, unsigned int xcols, [[maybe_unused]] const predict_params *params)
+int Predict64Ex(void *hsolver, const double *X, double *y, unsigned int rows, unsigned int xcols, const predict_params *params, unsigned int params_size)
 {
 	auto solver = (SolverHandle *)hsolver;
 
-	if (solver->mSolverParams.precision != 2)
+	if (solver->mSolverParams.precision != 2 && solver->mSolverParams.precision != 3)
 		return 1;
 
-	return Predict(*solver, X, y, rows, xcols, params);
+	const auto sized = Sized(params, params_size);
+	return Predict(*solver, X, y, rows, xcols, &sized);
 }
 
 void GetModel(const SymbolicRegression::HillClimb::CodeInfo info, math_model *model)
@@ -379,19 +888,30 @@ void GetModel(const SymbolicRegression::HillClimb::CodeInfo info, math_model *mo
 	}
 }
 
+int PredictEnsemble32(void *hsolver, const float *X, float *y, unsigned int rows, unsigned int xcols, const ensemble_params *params)
+{
+	auto solver = (SolverHandle *)hsolver;
+
+	if (solver->mSolverParams.precision != 1)
+		return 1;
+
+	return PredictEnsemble(*solver, X, y, rows, xcols, params);
+}
+
+int PredictEnsemble64(void *hsolver, const double *X, double *y, unsigned int rows, unsigned int xcols, const ensemble_params *params)
+{
+	auto solver = (SolverHandle *)hsolver;
+
+	if (solver->mSolverParams.precision != 2 && solver->mSolverParams.precision != 3)
+		return 1;
+
+	return PredictEnsemble(*solver, X, y, rows, xcols, params);
+}
+
 int GetBestModel(void *hsolver, math_model *model)
 {
 	SolverHandle &solver = *((SolverHandle *)hsolver);
-	auto bestScore = std::numeric_limits<double>::max();
-	ISolver *best = nullptr;
-	for (auto s : solver.mSolvers)
-	{
-		if (s->Score() < bestScore)
-		{
-			best = s;
-			bestScore = s->Score();
-		}
-	}
+	auto best = BestSolver(solver);
 	if (best)
 	{
 		const auto info = best->GetBestInfo();
@@ -406,7 +926,7 @@ int GetModel(void *hsolver, unsigned long long id, math_model *model)
 	SolverHandle &solver = *((SolverHandle *)hsolver);
 	const auto thread_id = id / solver.mSolverParams.pop_size;
 	const auto pop_id = id % solver.mSolverParams.pop_size;
-	if (thread_id > solver.mSolvers.size())
+	if (thread_id >= solver.mSolvers.size() || !solver.mSolvers[thread_id]->Published())
 		return 1;
 
 	const auto info = solver.mSolvers[thread_id]->GetInfo(thread_id, pop_id);
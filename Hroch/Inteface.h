@@ -8,8 +8,8 @@
 struct solver_params
 {
     unsigned long long random_state;
-    unsigned int num_threads;
-    unsigned int precision; // float32=1, float64=2
+    unsigned int num_threads; // solvers fitting in parallel, times the larger of neighbour_threads and score_threads also the threads of the handle for all its parallel work
+    unsigned int precision; // float32=1, float64=2, mixed=3 (float32 search, float64 refinement, fits and predicts float64)
     unsigned int pop_size;
     unsigned int transformation;
     double clip_min;
@@ -23,6 +23,16 @@ struct solver_params
     double init_predefined_const_prob;
     unsigned int init_predefined_const_count;
     const double *init_predefined_const_set;
+    unsigned int isa; // evaluation kernels, auto=0, sse4.2=1, avx2=2, avx512=3, falls back to the best supported
+    int eval_cache_mb; // per thread cache of intermediate results for incremental evaluation in MB, <=0 disables
+    int batch_neighbours; // evaluate all neighbours of a step together batch by batch, 0 evaluates them one by one
+    unsigned int storage; // inputs evaluated during the search, full=0, fp16=1, bf16=2, final scoring stays in full precision. The 16 bit copy halves the bytes the search reads, it is kept next to the full inputs so the inputs take 1.5 times the memory in float32, 1.25 times in float64
+    unsigned long long refine_iter_limit; // mixed precision, float64 steps re-tuning the constants of the found models, 0 only rescores them
+    unsigned int migration_interval; // island model, steps between the exchanges of the best codes of the threads, 0 isolates them
+    unsigned int migration_topology; // threads a thread imports from, ring=0 (its predecessor), full=1 (any other)
+    unsigned int neighbour_threads; // threads of the handle each solver splits the neighbours of a step and the scoring of its initial and final population over, 0 or 1 evaluates them on its own thread
+    unsigned int score_threads; // threads of the handle each solver splits the batches of a score over, when it has at least 64 per thread, 0 or 1 scores on its own thread
+    unsigned int numa; // 1 pins the threads to cores spread over the NUMA nodes and fits every node on its own copy of the data
 };
 
 struct fit_params
@@ -52,6 +62,33 @@ struct predict_params
 {
     unsigned long long id;
     unsigned int verbose;
+    unsigned int num_threads; // threads computing the predictions, 0 uses the solver's num_threads, at most those
+};
+
+struct ensemble_params
+{
+    const unsigned long long *ids; // models as predict_params::id, nullptr takes the top_k models
+    unsigned int ids_count;
+    unsigned int top_k;      // best models by the score on all data, then on the sample
+    const double *weights;   // per model, nullptr weights them equally
+    unsigned int average;    // 1 writes the weighted average to y, 0 the predictions of model k to y[k * rows]
+    unsigned int num_threads; // threads computing the predictions, 0 uses the solver's num_threads, at most those
+    unsigned int verbose;
+};
+
+struct fit_status
+{
+    unsigned int running;          // 1 until the fit finished
+    int result;                    // return value of the fit once it finished
+    unsigned int solvers;          // num_threads, the entries of the progress array filled
+    unsigned long long iterations; // steps of all the solvers so far
+    double best_score;             // best of the solvers' best_score
+};
+
+struct fit_progress
+{
+    unsigned long long iterations; // steps of the solver so far
+    double best_score;             // best sample score of its population so far, the score on all data of its best model once the fit finished
 };
 
 struct math_model
@@ -65,12 +102,35 @@ struct math_model
     double *used_constants;
 };
 
+// CreateSolver, Predict32 and Predict64 read solver_params and predict_params as of version 1.4.9 and take the
+// fields appended since as 0. The Ex variants read params_size bytes, sizeof the struct the caller was built
+// with, and take the fields past them as 0, so the struct can grow without breaking older callers.
 extern "C" EXPORT void *CreateSolver(const solver_params *params);
+extern "C" EXPORT void *CreateSolverEx(const solver_params *params, unsigned int params_size);
 extern "C" EXPORT void DeleteSolver(void *hsolver);
 extern "C" EXPORT int FitData32(void *hsolver, const float *X, const float *y, unsigned int rows, unsigned int xcols, const fit_params *params, const float *sw, unsigned int sw_len);
 extern "C" EXPORT int FitData64(void *hsolver, const double *X, const double *y, unsigned int rows, unsigned int xcols, const fit_params *params, const double *sw, unsigned int sw_len);
+// X, y and sw as above with the columns of X capacity values apart. X is used in place when it is 32 byte aligned
+// and capacity allows the padding to a multiple of 64 rows, the padding rows get overwritten, otherwise copied.
+// y and sw hold rows values, they are used in place when aligned and rows is a multiple of 64, never written.
+extern "C" EXPORT int FitData32Ex(void *hsolver, float *X, float *y, unsigned int rows, unsigned int capacity, unsigned int xcols, const fit_params *params, float *sw, unsigned int sw_len);
+extern "C" EXPORT int FitData64Ex(void *hsolver, double *X, double *y, unsigned int rows, unsigned int capacity, unsigned int xcols, const fit_params *params, double *sw, unsigned int sw_len);
+// FitData32/64 on a thread of its own, it returns at once and X, y, sw and what params points to must stay valid
+// until FitPoll reports the fit finished. The fits of a handle don't overlap, one started while another runs
+// returns 1. GetBestModel, GetModel, Predict and PredictEnsemble read the models found so far from another thread
+// meanwhile, one call at a time.
+extern "C" EXPORT int FitAsync32(void *hsolver, const float *X, const float *y, unsigned int rows, unsigned int xcols, const fit_params *params, const float *sw, unsigned int sw_len);
+extern "C" EXPORT int FitAsync64(void *hsolver, const double *X, const double *y, unsigned int rows, unsigned int xcols, const fit_params *params, const double *sw, unsigned int sw_len);
+// progress of the running or last fit, progress gets the first progress_count solvers, it may be nullptr
+extern "C" EXPORT int FitPoll(void *hsolver, fit_status *status, fit_progress *progress, unsigned int progress_count);
+// the running fit stops at the next step of its solvers and finishes with the best models found so far
+extern "C" EXPORT int FitCancel(void *hsolver);
 extern "C" EXPORT int Predict32(void *hsolver, const float *X, float *y, unsigned int rows, unsigned int xcols, const predict_params *params);
 extern "C" EXPORT int Predict64(void *hsolver, const double *X, double *y, unsigned int rows, unsigned int xcols, const predict_params *params);
+extern "C" EXPORT int Predict32Ex(void *hsolver, const float *X, float *y, unsigned int rows, unsigned int xcols, const predict_params *params, unsigned int params_size);
+extern "C" EXPORT int Predict64Ex(void *hsolver, const double *X, double *y, unsigned int rows, unsigned int xcols, const predict_params *params, unsigned int params_size);
+extern "C" EXPORT int PredictEnsemble32(void *hsolver, const float *X, float *y, unsigned int rows, unsigned int xcols, const ensemble_params *params);
+extern "C" EXPORT int PredictEnsemble64(void *hsolver, const double *X, double *y, unsigned int rows, unsigned int xcols, const ensemble_params *params);
 extern "C" EXPORT int GetBestModel(void *hsolver, math_model *model);
 extern "C" EXPORT int GetModel(void *hsolver, unsigned long long id, math_model *model);
 extern "C" EXPORT void FreeModel(math_model *model);
@@ -10,7 +10,8 @@ namespace Hroch
     enum class EDataType
     {
         F32,
-        F64
+        F64,
+        Mixed // float32 search, float64 refinement
     };
 
     using DataSetF = Utils::Dataset<float, BATCH>;
@@ -28,14 +29,24 @@ namespace Hroch
         virtual ~ISolver() = default;
         virtual void Fit(const DataSetF &, const FitParams &, const SampleWeightF *) = 0;
         virtual void Fit(const DataSetD &, const FitParams &, const SampleWeightD *) = 0;
-        virtual void Predict(DataSetF &, uint32_t, float, float) = 0;
-        virtual void Predict(DataSetD &, uint32_t, double, double) = 0;
-        virtual void Predict(DataSetF &, uint32_t, uint32_t, float, float) = 0;
-        virtual void Predict(DataSetD &, uint32_t, uint32_t, double, double) = 0;
+        virtual void Fit(const DataSetF &, const DataSetD &, const FitParams &, const SampleWeightF *, const SampleWeightD *) = 0;
+        virtual void Predict(DataSetF &, uint32_t, float, float, size_t, size_t) = 0;
+        virtual void Predict(DataSetD &, uint32_t, double, double, size_t, size_t) = 0;
+        virtual void Predict(DataSetF &, uint32_t, uint32_t, float, float, size_t, size_t) = 0;
+        virtual void Predict(DataSetD &, uint32_t, uint32_t, double, double, size_t, size_t) = 0;
         virtual double Score() const noexcept = 0;
+        virtual std::pair<double, double> GetScores(size_t idx) const noexcept = 0;
+        virtual bool Published() const noexcept = 0;
+        virtual std::pair<double, double> GetBestScores() const noexcept = 0;
+        virtual bool ReadModel(size_t idx, EvaluatedCode<float> &code) const noexcept = 0;
+        virtual bool ReadModel(size_t idx, EvaluatedCode<double> &code) const noexcept = 0;
         virtual HillClimb::CodeInfo GetBestInfo() = 0;
         virtual HillClimb::CodeInfo GetInfo(size_t threadId, size_t idx) noexcept = 0;
         virtual const Config &GetConfig() const noexcept = 0;
+        virtual void SetThreadPool(Utils::ThreadPool *) noexcept = 0;
+        virtual void SetProgress(HillClimb::FitProgress *, const std::atomic<bool> *) noexcept = 0;
+        virtual void SetMigration(HillClimb::Migration<float> *, size_t) noexcept = 0;
+        virtual void SetMigration(HillClimb::Migration<double> *, size_t) noexcept = 0;
     };
 
     template <typename SolverType, EDataType DataType>
@@ -74,35 +85,39 @@ namespace Hroch
             }
         }
 
-        void Predict(DataSetF &data, uint32_t transformation, float clipMin, float clipMax) noexcept override
+        void Fit(const DataSetF &, const DataSetD &, const FitParams &, const SampleWeightF *, const SampleWeightD *) override
+        {
+        }
+
+        void Predict(DataSetF &data, uint32_t transformation, float clipMin, float clipMax, size_t batchCount, size_t threads) noexcept override
         {
             if constexpr (DataType == EDataType::F32)
             {
-                SolverType::Predict(data, transformation, clipMin, clipMax);
+                SolverType::Predict(data, transformation, clipMin, clipMax, batchCount, threads);
             }
         }
 
-        void Predict(DataSetD &data, uint32_t transformation, double clipMin, double clipMax) noexcept override
+        void Predict(DataSetD &data, uint32_t transformation, double clipMin, double clipMax, size_t batchCount, size_t threads) noexcept override
         {
             if constexpr (DataType == EDataType::F64)
             {
-                SolverType::Predict(data, transformation, clipMin, clipMax);
+                SolverType::Predict(data, transformation, clipMin, clipMax, batchCount, threads);
             }
         }
 
-        void Predict(DataSetF &data, uint32_t transformation, uint32_t id, float clipMin, float clipMax) noexcept override
+        void Predict(DataSetF &data, uint32_t transformation, uint32_t id, float clipMin, float clipMax, size_t batchCount, size_t threads) noexcept override
         {
             if constexpr (DataType == EDataType::F32)
             {
-                SolverType::Predict(data, transformation, id, clipMin, clipMax);
+                SolverType::Predict(data, transformation, id, clipMin, clipMax, batchCount, threads);
             }
         }
 
-        void Predict(DataSetD &data, uint32_t transformation, uint32_t id, double clipMin, double clipMax) noexcept override
+        void Predict(DataSetD &data, uint32_t transformation, uint32_t id, double clipMin, double clipMax, size_t batchCount, size_t threads) noexcept override
         {
             if constexpr (DataType == EDataType::F64)
             {
-                SolverType::Predict(data, transformation, id, clipMin, clipMax);
+                SolverType::Predict(data, transformation, id, clipMin, clipMax, batchCount, threads);
             }
         }
 
@@ -111,6 +126,39 @@ namespace Hroch
             return SolverType::Score();
         }
 
+        std::pair<double, double> GetScores(size_t idx) const noexcept override
+        {
+            return SolverType::GetScores(idx);
+        }
+
+        bool Published() const noexcept override
+        {
+            return SolverType::Published();
+        }
+
+        std::pair<double, double> GetBestScores() const noexcept override
+        {
+            return SolverType::GetBestScores();
+        }
+
+        bool ReadModel(size_t idx, EvaluatedCode<float> &code) const noexcept override
+        {
+            if constexpr (DataType == EDataType::F32)
+            {
+                return SolverType::ReadModel(idx, code);
+            }
+            return false;
+        }
+
+        bool ReadModel(size_t idx, EvaluatedCode<double> &code) const noexcept override
+        {
+            if constexpr (DataType == EDataType::F64)
+            {
+                return SolverType::ReadModel(idx, code);
+            }
+            return false;
+        }
+
         HillClimb::CodeInfo GetBestInfo() noexcept override
         {
             return SolverType::GetBestInfo();
@@ -125,7 +173,197 @@ namespace Hroch
         {
             return SolverType::GetConfig();
         }
+
+        void SetThreadPool(Utils::ThreadPool *pool) noexcept override
+        {
+            SolverType::SetThreadPool(pool);
+        }
+
+        void SetProgress(HillClimb::FitProgress *progress, const std::atomic<bool> *cancel) noexcept override
+        {
+            SolverType::SetProgress(progress, cancel);
+        }
+
+        void SetMigration(HillClimb::Migration<float> *migration, size_t island) noexcept override
+        {
+            if constexpr (DataType == EDataType::F32)
+            {
+                SolverType::SetMigration(migration, island);
+            }
+        }
+
+        void SetMigration(HillClimb::Migration<double> *migration, size_t island) noexcept override
+        {
+            if constexpr (DataType == EDataType::F64)
+            {
+                SolverType::SetMigration(migration, island);
+            }
+        }
     };
+
+    // The hill climbing runs in float32 on a float copy of the data, the population is then rescored
+    // and its constants re-tuned in float64, the models, scores and predictions come from the float64 solver.
+    // Until its first refinement finishes they come from the search, converted to float64.
+    class MixedSolver : public ISolver
+    {
+        friend class SolverFactory;
+
+    protected:
+        MixedSolver(const Config &cfg)
+            : mSearch(cfg), mRefine(cfg)
+        {
+        }
+
+        static void test_callback([[maybe_unused]] const uint64_t it, [[maybe_unused]] const double err) noexcept
+        {
+        }
+
+    public:
+        virtual ~MixedSolver() = default;
+
+        void Fit(const DataSetF &, const FitParams &, const SampleWeightF *) override
+        {
+        }
+
+        void Fit(const DataSetD &, const FitParams &, const SampleWeightD *) override
+        {
+        }
+
+        void Fit(const DataSetF &search, const DataSetD &data, const FitParams &fp, const SampleWeightF *searchSw, const SampleWeightD *sw) override
+        {
+            mSearch.Fit(search, fp, test_callback, searchSw);
+            mRefine.Refine(data, fp, test_callback, mSearch.GetPopulation(), sw);
+        }
+
+        void Predict(DataSetF &, uint32_t, float, float, size_t, size_t) noexcept override
+        {
+        }
+
+        void Predict(DataSetD &data, uint32_t transformation, double clipMin, double clipMax, size_t batchCount, size_t threads) noexcept override
+        {
+            if (mRefine.Published())
+            {
+                mRefine.Predict(data, transformation, clipMin, clipMax, batchCount, threads);
+                return;
+            }
+            EvaluatedCode<double> code{mRefine.GetConfig().mCodeSettings};
+            ReadSearch(code, [&](auto &evc)
+                       { return mSearch.ReadBest(evc); });
+            mRefine.Predict(data, code.mCode, transformation, clipMin, clipMax, batchCount, threads);
+        }
+
+        void Predict(DataSetF &, uint32_t, uint32_t, float, float, size_t, size_t) noexcept override
+        {
+        }
+
+        void Predict(DataSetD &data, uint32_t transformation, uint32_t id, double clipMin, double clipMax, size_t batchCount, size_t threads) noexcept override
+        {
+            if (mRefine.Published())
+            {
+                mRefine.Predict(data, transformation, id, clipMin, clipMax, batchCount, threads);
+                return;
+            }
+            EvaluatedCode<double> code{mRefine.GetConfig().mCodeSettings};
+            ReadModel(id, code);
+            mRefine.Predict(data, code.mCode, transformation, clipMin, clipMax, batchCount, threads);
+        }
+
+        double Score() const noexcept override
+        {
+            return GetBestScores().first;
+        }
+
+        std::pair<double, double> GetScores(size_t idx) const noexcept override
+        {
+            return mRefine.Published() ? mRefine.GetScores(idx) : mSearch.GetScores(idx);
+        }
+
+        bool Published() const noexcept override
+        {
+            return mRefine.Published() || mSearch.Published();
+        }
+
+        std::pair<double, double> GetBestScores() const noexcept override
+        {
+            return mRefine.Published() ? mRefine.GetBestScores() : mSearch.GetBestScores();
+        }
+
+        bool ReadModel(size_t, EvaluatedCode<float> &) const noexcept override
+        {
+            return false;
+        }
+
+        bool ReadModel(size_t idx, EvaluatedCode<double> &code) const noexcept override
+        {
+            if (mRefine.Published())
+                return mRefine.ReadModel(idx, code);
+            return ReadSearch(code, [&](auto &evc)
+                              { return mSearch.ReadModel(idx, evc); });
+        }
+
+        HillClimb::CodeInfo GetBestInfo() noexcept override
+        {
+            if (mRefine.Published())
+                return mRefine.GetBestInfo();
+            EvaluatedCode<double> code{mRefine.GetConfig().mCodeSettings};
+            ReadSearch(code, [&](auto &evc)
+                       { return mSearch.ReadBest(evc); });
+            return mRefine.GetInfo(code, "equation");
+        }
+
+        HillClimb::CodeInfo GetInfo(size_t threadId, size_t idx) noexcept override
+        {
+            if (mRefine.Published())
+                return mRefine.GetInfo(threadId, idx);
+            EvaluatedCode<double> code{mRefine.GetConfig().mCodeSettings};
+            ReadModel(idx, code);
+            return mRefine.GetInfo(code, "equation_" + std::to_string(threadId) + "_" + std::to_string(idx));
+        }
+
+        const Config &GetConfig() const noexcept override
+        {
+            return mRefine.GetConfig();
+        }
+
+        void SetThreadPool(Utils::ThreadPool *pool) noexcept override
+        {
+            mSearch.SetThreadPool(pool);
+            mRefine.SetThreadPool(pool);
+        }
+
+        // the refinement continues the iterations and the score of the search, a cancelled search is still rescored in float64
+        void SetProgress(HillClimb::FitProgress *progress, const std::atomic<bool> *cancel) noexcept override
+        {
+            mSearch.SetProgress(progress, cancel);
+            mRefine.SetProgress(progress, cancel);
+        }
+
+        // the islands migrate during the search
+        void SetMigration(HillClimb::Migration<float> *migration, size_t island) noexcept override
+        {
+            mSearch.SetMigration(migration, island);
+        }
+
+        void SetMigration(HillClimb::Migration<double> *, size_t) noexcept override
+        {
+        }
+
+    private:
+        // a code read from the search by read, converted to float64
+        template <typename F>
+        bool ReadSearch(EvaluatedCode<double> &code, F &&read) const noexcept
+        {
+            EvaluatedCode<float> search{mSearch.GetConfig().mCodeSettings};
+            if (!read(search))
+                return false;
+            code = EvaluatedCode<double>{search};
+            return true;
+        }
+
+        SolverF mSearch;
+        SolverD mRefine;
+    };
+
     class SolverFactory
     {
     public:
@@ -136,6 +374,8 @@ namespace Hroch
                 solver = new SolverWrapper<SolverF, EDataType::F32>(cfg);
             if (dataType == EDataType::F64)
                 solver = new SolverWrapper<SolverD, EDataType::F64>(cfg);
+            if (dataType == EDataType::Mixed)
+                solver = new MixedSolver(cfg);
             return solver;
         }
     };
@@ -4,8 +4,8 @@
 namespace Hroch
 {
     inline constexpr uint32_t VERSION_MAJOR = 1;
-    inline constexpr uint32_t VERSION_MINOR = 4;
-    inline constexpr uint32_t VERSION_REVISION = 9;
+    inline constexpr uint32_t VERSION_MINOR = 5;
+    inline constexpr uint32_t VERSION_REVISION = 0;
 
     inline void PrintVersion()
     {
@@ -29,6 +29,19 @@ namespace SymbolicRegression::Computer
         {
         }
 
+        // same program with the constants rounded to T
+        template <typename U>
+        explicit Code(const Code<U> &other) noexcept
+            : mInputSize(other.mInputSize),
+              mCodeSize(other.mCodeSize),
+              mConstants(other.mConstants.begin(), other.mConstants.end()),
+              mCodeInstructions(other.mCodeInstructions),
+              mTreeComplexity(other.mTreeComplexity),
+              mUsedInstructions(other.mUsedInstructions),
+              mUsedConst(other.mUsedConst)
+        {
+        }
+
         auto MaxSize() const noexcept
         {
             return mCodeInstructions.size();
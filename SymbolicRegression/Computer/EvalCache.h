@@ -0,0 +1,177 @@
+#pragma once
+
+#include "Code.h"
+#include "Program.h"
+#include "../Utils/BatchVector.h"
+
+namespace SymbolicRegression::Computer
+{
+    // Snapshot of a hill climber's current code, live intermediates except the output are stored in an entry
+    // at instruction index * BATCH
+    template <typename T>
+    struct CachedParent
+    {
+        explicit CachedParent(const CodeSettings &cs) noexcept
+            : mCode(cs)
+        {
+        }
+
+        Code<T> mCode;
+        std::vector<size_t> mOffset{};    // per instruction, NO_CACHE when it is not stored
+        Program<T> mFill{};               // computes the stored intermediates of one batch
+        std::vector<uint32_t> mEntries{}; // cache entry per batch index
+        std::vector<uint32_t> mOwned{};   // entries holding this parent's batches
+        bool mValid{false};
+    };
+
+    // Per batch intermediate results of the parents (hill climber currents) of the evaluated neighbours.
+    // Entries are fixed size blocks of a preallocated pool shared by all parents and recycled in LRU order.
+    // When a parent's code changes, Machine updates its entries in place rather than dropping them.
+    template <typename T, size_t BATCH>
+    class EvalCache
+    {
+        constexpr static uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    public:
+        EvalCache(const CodeSettings &cs, size_t parentCount, size_t bytes) noexcept
+            : mEntrySize((size_t)cs.mMaxCodeSize * BATCH),
+              mEntryCount(std::min<size_t>(bytes / (mEntrySize * sizeof(T)), NONE - 1))
+        {
+            if (!Enabled())
+                return;
+
+            mPool = std::make_unique<Utils::BatchVector<T, BATCH>>(mEntryCount * mEntrySize);
+            mParents.reserve(parentCount);
+            for (size_t i = 0; i < parentCount; i++)
+                mParents.emplace_back(cs);
+            mOwner.resize(mEntryCount);
+            mBatch.resize(mEntryCount);
+            mPos.resize(mEntryCount);
+            mPrev.resize(mEntryCount);
+            mNext.resize(mEntryCount);
+        }
+
+        EvalCache(const EvalCache &) = delete;
+        EvalCache &operator=(const EvalCache &) = delete;
+
+        bool Enabled() const noexcept
+        {
+            return mEntryCount > 0;
+        }
+
+        // drops everything, the cached values depend on the dataset
+        void Reset(size_t batchCount) noexcept
+        {
+            if (!Enabled())
+                return;
+
+            for (auto &p : mParents)
+            {
+                p.mValid = false;
+                p.mEntries.assign(batchCount, NONE);
+                p.mOwned.clear();
+            }
+            for (uint32_t e = 0; e < mEntryCount; e++)
+            {
+                mOwner[e] = NONE;
+                mPrev[e] = e == 0 ? NONE : e - 1;
+                mNext[e] = e + 1 == mEntryCount ? NONE : e + 1;
+            }
+            mHead = 0;
+            mTail = static_cast<uint32_t>(mEntryCount - 1);
+        }
+
+        CachedParent<T> &Parent(size_t parent) noexcept
+        {
+            return mParents[parent];
+        }
+
+        // entry of the batch, nullptr when it is not cached
+        T *Find(size_t parent, size_t batchIndex) noexcept
+        {
+            const auto e = mParents[parent].mEntries[batchIndex];
+            if (e == NONE)
+                return nullptr;
+            MoveToFront(e);
+            return Entry(e);
+        }
+
+        // recycles the least recently used entry, the caller fills it
+        T *Insert(size_t parent, size_t batchIndex) noexcept
+        {
+            const auto e = mTail;
+            if (mOwner[e] != NONE)
+            {
+                auto &old = mParents[mOwner[e]];
+                old.mEntries[mBatch[e]] = NONE;
+                mPos[old.mOwned.back()] = mPos[e];
+                old.mOwned[mPos[e]] = old.mOwned.back();
+                old.mOwned.pop_back();
+            }
+            auto &p = mParents[parent];
+            mOwner[e] = static_cast<uint32_t>(parent);
+            mBatch[e] = static_cast<uint32_t>(batchIndex);
+            mPos[e] = static_cast<uint32_t>(p.mOwned.size());
+            p.mOwned.push_back(e);
+            p.mEntries[batchIndex] = e;
+            MoveToFront(e);
+            return Entry(e);
+        }
+
+        // calls f(batchIndex, entry) for every cached batch of the parent
+        template <typename F>
+        void ForEachEntry(size_t parent, F &&f) noexcept
+        {
+            for (const auto e : mParents[parent].mOwned)
+                f(mBatch[e], Entry(e));
+        }
+
+        static bool SameCode(const Code<T> &a, const Code<T> &b) noexcept
+        {
+            if (a.Size() != b.Size() || a.mConstants != b.mConstants)
+                return false;
+            for (size_t i = 0; i < a.Size(); i++)
+            {
+                const auto &x = a[i];
+                const auto &y = b[i];
+                if (x.mOpCode != y.mOpCode || x.mSrc[0] != y.mSrc[0] || x.mSrc[1] != y.mSrc[1] ||
+                    x.mConst[0] != y.mConst[0] || x.mConst[1] != y.mConst[1])
+                    return false;
+            }
+            return true;
+        }
+
+    private:
+        T *Entry(uint32_t e) noexcept
+        {
+            return mPool->GetData() + e * mEntrySize;
+        }
+
+        void MoveToFront(uint32_t e) noexcept
+        {
+            if (mHead == e)
+                return;
+            mNext[mPrev[e]] = mNext[e];
+            if (mNext[e] != NONE)
+                mPrev[mNext[e]] = mPrev[e];
+            else
+                mTail = mPrev[e];
+            mPrev[e] = NONE;
+            mNext[e] = mHead;
+            mPrev[mHead] = e;
+            mHead = e;
+        }
+
+        const size_t mEntrySize;
+        const size_t mEntryCount;
+        std::unique_ptr<Utils::BatchVector<T, BATCH>> mPool{};
+        std::vector<CachedParent<T>> mParents{};
+        std::vector<uint32_t> mOwner{};
+        std::vector<uint32_t> mBatch{};
+        std::vector<uint32_t> mPos{}; // position in the owner's mOwned
+        std::vector<uint32_t> mPrev{};
+        std::vector<uint32_t> mNext{};
+        uint32_t mHead{NONE};
+        uint32_t mTail{NONE};
+    };
+}
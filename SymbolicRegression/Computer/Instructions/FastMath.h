@@ -0,0 +1,307 @@
+#pragma once
+
+#include "../../Defs.h"
+
+// Branch-free approximations of the transcendental instructions. Only arithmetic, compares and
+// integer bit operations are used, so the BATCH loops in Processor vectorize for the target ISA
+// without libmvec/SVML. Float versions evaluate in double and round once.
+// Max error vs. correctly rounded result, measured over random arguments in the stated range, gcc with
+// the flags of Hroch/clang.sh (-O3 -funsafe-math-optimizations):
+//
+//   function    float     double
+//   Exp         0.5 ulp   1.3 ulp  results below the smallest normal flush to zero
+//   ExpM1       0.5 ulp   1.9 ulp
+//   Log         0.5 ulp   0.9 ulp
+//   Sin/Cos     0.5 ulp   2.3 ulp  |x| < 1.6e6 (SIN_COS_RANGE), beyond that the reduction is inexact,
+//                                  the sin and cos instructions compute those operands with std::sin/cos
+//   Tanh        0.5 ulp   2.5 ulp
+//   Sinh/Cosh   0.5 ulp   2.3 ulp  Sinh overflows from |x| > 709.78, Cosh like std::cosh from 710.48
+//   Pow         0.5 ulp   1 ulp + |b * ln(a)| ulp, the error of log(a) scaled by b, 150 ulp over
+//                         a in [0, 20], b in [-20, 20]
+//   Cbrt        0.5 ulp   0.8 ulp
+//
+// The compensated steps must not be reassociated. Barrier hides their values from gcc and msvc,
+// clang is told with FAST_MATH_EXACT.
+//
+// Define STD_MATH (Defs.h) to forward everything to <cmath> instead.
+#if defined(__clang__)
+#define FAST_MATH_EXACT _Pragma("clang fp reassociate(off)")
+#else
+#define FAST_MATH_EXACT
+#endif
+
+namespace SymbolicRegression::Computer::FastMath
+{
+    namespace Detail
+    {
+        constexpr double LOG2E = 1.44269504088896338700;
+        constexpr double LN2_HI = 6.93147180369123816490e-01; // upper 32 bits of ln2
+        constexpr double LN2_LO = 1.90821492927058770002e-10;
+        constexpr double PIO2_1 = 1.57079632673412561417e+00; // upper 33 bits of pi/2
+        constexpr double PIO2_2 = 6.07710050630396597660e-11;
+        constexpr double PIO2_3 = 2.02226624879595063154e-21;
+        constexpr double TWO_O_PI = 6.36619772367581382433e-01;
+        // n * PIO2_1 is exact below 2^20 quadrants
+        constexpr double PIO2_MAX = 1.647099e6;
+        constexpr double EXP_HI = 709.782712893383973096;
+        constexpr double LN2 = 6.93147180559945309417e-01;
+        constexpr double EXP_LO = -708.396418532264106224;
+        constexpr double MIN_NORMAL = 2.2250738585072014e-308;
+        constexpr double TWO52 = 4503599627370496.0;
+        constexpr double SQRT2 = 1.41421356237309504880;
+
+        // Never written. XOR-ing with it hides a value from -fassociative-math, which would
+        // otherwise recombine the split constants below and lose the low order bits.
+        inline uint64_t gBarrier = 0;
+
+        ALWAYS_INLINE double Barrier(double v) noexcept
+        {
+            return std::bit_cast<double>(std::bit_cast<uint64_t>(v) ^ gBarrier);
+        }
+
+        ALWAYS_INLINE double Pow2(double n) noexcept
+        {
+            // n is integral in [-1022, 1023], the addition leaves n + 1023 in the low mantissa bits
+            const auto bits = std::bit_cast<uint64_t>(n + (TWO52 + 1023.0));
+            return std::bit_cast<double>(bits << 52);
+        }
+
+        // Horner over the first N coefficients, float targets need fewer terms
+        template <int N>
+        ALWAYS_INLINE double Poly(double x, const double (&c)[12]) noexcept
+        {
+            auto p = c[N - 1];
+            for (int i = N - 2; i >= 0; i--)
+                p = p * x + c[i];
+            return p;
+        }
+
+        // exp(r) - 1 for |r| <= ln2 / 2
+        template <typename T>
+        ALWAYS_INLINE double ExpM1Poly(double r) noexcept
+        {
+            constexpr double c[] = {1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040, 1.0 / 40320,
+                                    1.0 / 362880, 1.0 / 3628800, 1.0 / 39916800, 1.0 / 479001600, 1.0 / 6227020800};
+            return r + r * r * Poly<sizeof(T) == 4 ? 7 : 12>(r, c);
+        }
+
+        // x = n * ln2 + r, returns n and writes r
+        ALWAYS_INLINE double ReduceLn2(double x, double &r) noexcept
+        {
+            FAST_MATH_EXACT
+            const auto n = std::floor(x * LOG2E + 0.5);
+            r = Barrier(x - n * LN2_HI) - n * LN2_LO;
+            return n;
+        }
+
+        // exp(x) * 2^K, K = -1 keeps exp(x) / 2 finite up to EXP_HI + ln2
+        template <typename T, int K = 0>
+        ALWAYS_INLINE double Exp(double x) noexcept
+        {
+            constexpr double hi = EXP_HI - K * LN2;
+            const auto xc = std::min(std::max(x, EXP_LO), hi);
+            double r;
+            const auto n = ReduceLn2(xc, r) + K;
+            // two factors so that n = 1024 near the overflow threshold stays representable, kept apart
+            const auto h = std::floor(n * 0.5);
+            auto y = Barrier((ExpM1Poly<T>(r) + 1.0) * Pow2(h)) * Pow2(n - h);
+            y = x > hi ? std::numeric_limits<double>::infinity() : y;
+            y = x < EXP_LO ? 0.0 : y;
+            return x != x ? x : y;
+        }
+
+        template <typename T>
+        ALWAYS_INLINE double ExpM1(double x) noexcept
+        {
+            FAST_MATH_EXACT
+            const auto xc = std::min(std::max(x, -40.0), EXP_HI);
+            double r;
+            const auto n = ReduceLn2(xc, r);
+            // 2^n (p + 1) - 1 = 2^(n-h) (2^h p + 2^h - 2^(h-n)), no factor overflows for n = 1024
+            const auto h = std::floor(n * 0.5);
+            const auto s = Pow2(h);
+            const auto p = ExpM1Poly<T>(r);
+            auto y = n == 0.0 ? p : Barrier(s * p + Barrier(s - Pow2(h - n))) * Pow2(n - h);
+            y = x > EXP_HI ? std::numeric_limits<double>::infinity() : y;
+            y = x < -40.0 ? -1.0 : y;
+            return x != x ? x : y;
+        }
+
+        template <typename T>
+        ALWAYS_INLINE double Log(double x) noexcept
+        {
+            FAST_MATH_EXACT
+            // scale subnormals into the normal range
+            const auto small = x < MIN_NORMAL;
+            const auto xs = small ? x * TWO52 : x;
+            const auto bits = std::bit_cast<uint64_t>(xs);
+            // biased exponent as double without an integer conversion
+            auto e = std::bit_cast<double>((bits >> 52) | 0x4330000000000000ULL) - (TWO52 + 1023.0);
+            e = small ? e - 52.0 : e;
+            auto m = std::bit_cast<double>((bits & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL);
+            const auto big = m > SQRT2;
+            m = big ? m * 0.5 : m;
+            e = big ? e + 1.0 : e;
+
+            // log(m) = 2 atanh(s), s = (m - 1) / (m + 1), |s| < 0.1716
+            const auto f = m - 1.0;
+            const auto s = f / (2.0 + f);
+            const auto z = s * s;
+            constexpr double c[] = {1.0 / 3, 1.0 / 5, 1.0 / 7, 1.0 / 9, 1.0 / 11, 1.0 / 13, 1.0 / 15, 1.0 / 17, 1.0 / 19, 1.0 / 21, 1.0 / 23, 1.0 / 25};
+            const auto p = Poly<sizeof(T) == 4 ? 6 : 10>(z, c);
+            const auto hf = 0.5 * f * f;
+            const auto R = 2.0 * z * p;
+            auto y = e * LN2_HI + Barrier(f - Barrier(hf - Barrier(s * (hf + R) + e * LN2_LO)));
+
+            y = x == 0.0 ? -std::numeric_limits<double>::infinity() : y;
+            y = x < 0.0 ? std::numeric_limits<double>::quiet_NaN() : y;
+            y = x == std::numeric_limits<double>::infinity() ? x : y;
+            return x != x ? x : y;
+        }
+
+        template <typename T>
+        ALWAYS_INLINE double SinPoly(double r) noexcept
+        {
+            constexpr double c[] = {-1.0 / 6, 1.0 / 120, -1.0 / 5040, 1.0 / 362880, -1.0 / 39916800,
+                                    1.0 / 6227020800, -1.0 / 1307674368000, 1.0 / 355687428096000,
+                                    -1.0 / 121645100408832000, 1.0 / 51090942171709440000.0, 0.0, 0.0};
+            const auto z = r * r;
+            return r + r * z * Poly<sizeof(T) == 4 ? 5 : 8>(z, c);
+        }
+
+        template <typename T>
+        ALWAYS_INLINE double CosPoly(double r) noexcept
+        {
+            constexpr double c[] = {1.0 / 24, -1.0 / 720, 1.0 / 40320, -1.0 / 3628800, 1.0 / 479001600,
+                                    -1.0 / 87178291200, 1.0 / 20922789888000, -1.0 / 6402373705728000,
+                                    1.0 / 2432902008176640000.0, 0.0, 0.0, 0.0};
+            const auto z = r * r;
+            return (1.0 - 0.5 * z) + z * z * Poly<sizeof(T) == 4 ? 4 : 8>(z, c);
+        }
+
+        // x = n * pi/2 + r, returns n mod 4 and writes r
+        ALWAYS_INLINE double ReducePio2(double x, double &r) noexcept
+        {
+            FAST_MATH_EXACT
+            const auto n = std::floor(x * TWO_O_PI + 0.5);
+            r = Barrier(Barrier(x - n * PIO2_1) - n * PIO2_2) - n * PIO2_3;
+            return n - 4.0 * std::floor(n * 0.25);
+        }
+
+        template <typename T>
+        ALWAYS_INLINE double Sin(double x) noexcept
+        {
+            double r;
+            const auto q = ReducePio2(x, r);
+            const auto s = SinPoly<T>(r);
+            const auto c = CosPoly<T>(r);
+            const auto y = q == 1.0 || q == 3.0 ? c : s;
+            return q >= 2.0 ? -y : y;
+        }
+
+        template <typename T>
+        ALWAYS_INLINE double Cos(double x) noexcept
+        {
+            double r;
+            const auto q = ReducePio2(x, r);
+            const auto s = SinPoly<T>(r);
+            const auto c = CosPoly<T>(r);
+            const auto y = q == 1.0 || q == 3.0 ? s : c;
+            return q == 1.0 || q == 2.0 ? -y : y;
+        }
+
+        template <typename T>
+        ALWAYS_INLINE double Tanh(double x) noexcept
+        {
+            // tanh(|x|) = -expm1(-2|x|) / (expm1(-2|x|) + 2), no cancellation near zero
+            const auto e = ExpM1<T>(-2.0 * std::abs(x));
+            const auto t = -e / (e + 2.0);
+            return x < 0.0 ? -t : t;
+        }
+
+        template <typename T>
+        ALWAYS_INLINE double Sinh(double x) noexcept
+        {
+            const auto a = std::abs(x);
+            const auto e = ExpM1<T>(a);
+            auto t = 0.5 * (e + e / (e + 1.0));
+            t = a > EXP_HI ? std::numeric_limits<double>::infinity() : t;
+            t = x != x ? x : t;
+            return x < 0.0 ? -t : t;
+        }
+
+        template <typename T>
+        ALWAYS_INLINE double Cosh(double x) noexcept
+        {
+            // exp(|x|) / 2
+            const auto e = Exp<T, -1>(std::abs(x));
+            return e + 0.25 / e;
+        }
+
+        template <typename T>
+        ALWAYS_INLINE double Pow(double a, double b) noexcept
+        {
+            const auto integral = std::floor(b) == b;
+            const auto odd = (b - 2.0 * std::floor(b * 0.5)) == 1.0;
+            // b * log|a| amplifies the log error, so float targets use the full polynomials here.
+            // log(0) = -inf already gives 0 or inf, the selects are kept flat so the loop stays branch free
+            auto y = Exp<double>(b * Log<double>(std::abs(a)));
+            y = (a < 0.0) & odd ? -y : y;
+            y = (a < 0.0) & !integral ? std::numeric_limits<double>::quiet_NaN() : y;
+            return (b == 0.0) | (a == 1.0) ? 1.0 : y;
+        }
+
+        template <typename T>
+        ALWAYS_INLINE double Cbrt(double a) noexcept
+        {
+            const auto x = std::abs(a);
+            auto y = Exp<T>(Log<T>(x) * (1.0 / 3.0));
+            // one Newton step for y^3 = x
+            y = y - (y - x / (y * y)) * (1.0 / 3.0);
+            y = x == 0.0 || x == std::numeric_limits<double>::infinity() || x != x ? x : y;
+            return a < 0.0 ? -y : y;
+        }
+    }
+
+    // |x| below which Sin and Cos are accurate
+    constexpr double SIN_COS_RANGE = Detail::PIO2_MAX;
+
+#ifdef STD_MATH
+#define DEF_FAST_MATH_1(name, std_name)                                     \
+    template <typename T>                                                   \
+    ALWAYS_INLINE T name(const T a) noexcept                                \
+    {                                                                       \
+        return std::std_name(a);                                            \
+    }
+#else
+#define DEF_FAST_MATH_1(name, std_name)                                     \
+    template <typename T>                                                   \
+    ALWAYS_INLINE T name(const T a) noexcept                                \
+    {                                                                       \
+        return static_cast<T>(Detail::name<T>(static_cast<double>(a)));     \
+    }
+#endif
+
+    DEF_FAST_MATH_1(Exp, exp)
+    DEF_FAST_MATH_1(ExpM1, expm1)
+    DEF_FAST_MATH_1(Log, log)
+    DEF_FAST_MATH_1(Sin, sin)
+    DEF_FAST_MATH_1(Cos, cos)
+    DEF_FAST_MATH_1(Tanh, tanh)
+    DEF_FAST_MATH_1(Sinh, sinh)
+    DEF_FAST_MATH_1(Cosh, cosh)
+    DEF_FAST_MATH_1(Cbrt, cbrt)
+
+#undef DEF_FAST_MATH_1
+#undef FAST_MATH_EXACT
+
+    template <typename T>
+    ALWAYS_INLINE T Pow(const T a, const T b) noexcept
+    {
+#ifdef STD_MATH
+        return std::pow(a, b);
+#else
+        return static_cast<T>(Detail::Pow<T>(static_cast<double>(a), static_cast<double>(b)));
+#endif
+    }
+}
@@ -2,6 +2,7 @@
 
 #include "Prototype.h"
 #include "BasicMath.h"
+#include "FastMath.h"
 #include "AdvancedMath.h"
 #include "Fuzzy.h"
 #include "CodeGen.h"
@@ -52,9 +52,7 @@ namespace SymbolicRegression::Computer::Instructions
         f_nimpl
     };
 
-#define DEF_INSTR(name, op, code)                                                    \
-    struct instruction_##name                                                        \
-    {                                                                                \
+#define DEF_INSTR_MEMBERS(name, op, code)                                            \
         constexpr static uint32_t operands = op;                                     \
         constexpr static InstructionID id = InstructionID::name;                     \
         template <typename T>                                                        \
@@ -69,6 +67,24 @@ namespace SymbolicRegression::Computer::Instructions
         constexpr auto get_code() const noexcept                                     \
         {                                                                            \
             return #code;                                                            \
+        }
+
+#define DEF_INSTR(name, op, code)                                                    \
+    struct instruction_##name                                                        \
+    {                                                                                \
+        DEF_INSTR_MEMBERS(name, op, code)                                            \
+    }
+
+// code is accurate for |a| < range only, Processor computes the operands beyond it with exact
+#define DEF_INSTR_RANGE(name, op, code, range, exact)                                \
+    struct instruction_##name                                                        \
+    {                                                                                \
+        DEF_INSTR_MEMBERS(name, op, code)                                            \
+        constexpr static double RANGE = range;                                       \
+        template <typename T>                                                        \
+        static T Exact(const T a) noexcept                                           \
+        {                                                                            \
+            return (exact);                                                          \
         }                                                                            \
     }
 }
@@ -5,6 +5,7 @@
 #include "Code.h"
 #include "../Utils/Dataset.h"
 #include "../Utils/Evaluate.h"
+#include "../Utils/ThreadPool.h"
 
 namespace SymbolicRegression::Computer
 {
@@ -16,14 +17,59 @@ namespace SymbolicRegression::Computer
 		Machine() = delete;
 
 	public:
-		explicit Machine(const CodeSettings &cs) noexcept
+		constexpr static double NO_BOUND = std::numeric_limits<double>::max();
+
+		Machine(const CodeSettings &cs, Utils::Isa isa, size_t cacheParents = 0, size_t cacheBytes = 0) noexcept
 			: mCodeSettings(cs),
 			  mMemory(cs),
-			  mProcessor(cs)
+			  mProcessor(cs, isa),
+			  mCache(cs, cacheParents, cacheBytes),
+			  mScoreBatch(mScoreKernels[Utils::IsaIndex(isa)].data()),
+			  mFinishBatch(mFinishKernels[Utils::IsaIndex(isa)])
 		{
 		}
 
-		void ComputeScore(
+		// cached intermediates are only valid for the dataset they were computed on
+		void ResetCache(const Dataset &data) noexcept
+		{
+			mCache.Reset(data.BatchCount());
+			mParent = NO_PARENT;
+		}
+
+		// threads the parallel work runs on, without a pool it runs on the calling thread
+		void SetThreadPool(Utils::ThreadPool *pool) noexcept
+		{
+			mPool = pool;
+		}
+
+		// parent of the following incremental ComputeScore calls, when its code changed the batches still cached
+		// for it are brought up to date by executing only the instructions that differ
+		void SetParent(const Dataset &data, size_t parent, const Code<T> &code) noexcept
+		{
+			if (!mCache.Enabled())
+				return;
+			mParent = parent;
+			auto &cp = mCache.Parent(parent);
+			if (cp.mValid && EvalCache<T, BATCH>::SameCode(cp.mCode, code))
+				return;
+
+			if (cp.mValid && !cp.mOwned.empty())
+			{
+				mProcessor.CompileFill(code, data, &cp, mRepair, mRepairOffset, true);
+				mCache.ForEachEntry(parent, [&](size_t batchIdx, T *entry) noexcept
+									 { mProcessor.Execute(mRepair, batchIdx, entry); });
+			}
+			cp.mCode = code;
+			cp.mValid = true;
+			mProcessor.CompileFill(cp.mCode, data, nullptr, cp.mFill, cp.mOffset, true);
+		}
+
+		// With a bound, scoring stops once the mean over the whole selection is certain to reach it, the
+		// result is then partial and false is returned. Only metrics whose batch scores can't be negative
+		// stop early, see CanAbort. A compact dataset is read in its 16 bit form unless fullPrecision is set,
+		// the cached parent intermediates are compact too, so full precision scoring doesn't use them.
+		// Selections of at least MIN_THREAD_BATCHES batches per thread are split over threads, see ComputeScoreThreads.
+		bool ComputeScore(
 			const Dataset &data,
 			const Code<T> &code,
 			const std::vector<size_t> &batchSelection,
@@ -34,131 +80,370 @@ namespace SymbolicRegression::Computer
 			T clipMax,
 			T cw0,
 			T cw1,
-			bool filter = true,
-			const Utils::BatchVector<T, BATCH> *sampleWeight = nullptr) noexcept
+			const Utils::BatchVector<T, BATCH> *sampleWeight = nullptr,
+			bool incremental = false,
+			double bound = NO_BOUND,
+			bool fullPrecision = false,
+			size_t threads = 1) noexcept
 		{
-			T *__restrict yPred = mMemory[code.Size() - 1];
-			const auto clip = clipMin < clipMax;
-			const auto cw = cw0 != cw1;
+			threads = std::min({threads, batchSelection.size() / MIN_THREAD_BATCHES, mPool ? mPool->Size() : size_t{1}});
+			if (threads > 1)
+				return ComputeScoreThreads(data, code, batchSelection, r, transformation, metric, clipMin, clipMax, cw0, cw1, sampleWeight, bound, fullPrecision, threads);
+
+			auto *parent = incremental && !fullPrecision && mParent != NO_PARENT ? &mCache.Parent(mParent) : nullptr;
+			mProcessor.Compile(code, data, mMemory, mProgram, parent, !fullPrecision);
+			T *__restrict yPred = mProgram.mOutput;
+			const auto scoreBatch = mScoreBatch[ScoreIndex(metric, transformation, clipMin < clipMax, cw0 != cw1, sampleWeight != nullptr)];
+			const auto abort = bound != NO_BOUND && CanAbort(metric, transformation, clipMin, clipMax);
 
 			for (const auto batchIdx : batchSelection)
 			{
 				const T *__restrict yTrue = data.BatchY(batchIdx);
 				const T *__restrict sw = sampleWeight ? sampleWeight->GetBatch(batchIdx) : nullptr;
 
-				mProcessor.Execute(code, data, mMemory, batchIdx, filter);
+				T *entry = nullptr;
+				ExecuteBatch(mProgram, parent, batchIdx, entry);
+				r.Add(batchIdx, scoreBatch(yTrue, yPred, sw, clipMin, clipMax, cw0, cw1));
+				if (abort && Reaches(r, batchSelection.size(), bound))
+					return false;
+			}
+			return true;
+		}
 
-				auto score = 0.0;
+		// ComputeScore of several codes at once, *r[k] gets the results of codes[k]. The codes are run one after
+		// another on each batch, so its inputs, targets and the parent's cache entry are loaded once and stay in
+		// cache for all of them. Each code gets its own program and memory. Codes reaching the bound are
+		// dropped from the following batches, complete[k] tells whether *r[k] covers the whole selection.
+		void ComputeScores(
+			const Dataset &data,
+			const std::vector<const Code<T> *> &codes,
+			const std::vector<size_t> &batchSelection,
+			const std::vector<Utils::Result<BATCH> *> &r,
+			uint32_t transformation,
+			uint32_t metric,
+			T clipMin,
+			T clipMax,
+			T cw0,
+			T cw1,
+			const Utils::BatchVector<T, BATCH> *sampleWeight,
+			std::vector<uint8_t> &complete,
+			bool incremental = false,
+			double bound = NO_BOUND) noexcept
+		{
+			auto *parent = incremental && mParent != NO_PARENT ? &mCache.Parent(mParent) : nullptr;
+			while (mPrograms.size() < codes.size())
+			{
+				mPrograms.emplace_back();
+				mMemories.push_back(std::make_unique<Memory<T, BATCH>>(mCodeSettings));
+			}
+			for (size_t k = 0; k < codes.size(); k++)
+			{
+				mProcessor.Compile(*codes[k], data, *mMemories[k], mPrograms[k], parent, true);
+			}
+			const auto scoreBatch = mScoreBatch[ScoreIndex(metric, transformation, clipMin < clipMax, cw0 != cw1, sampleWeight != nullptr)];
+			const auto abort = bound != NO_BOUND && CanAbort(metric, transformation, clipMin, clipMax);
+			complete.assign(codes.size(), 1);
+			auto active = codes.size();
 
-				// Logit approximation directly compute score log(1+exp(−f(x))) resp. log(1+exp(f(x)))
-				if (metric == 20)
+			for (const auto batchIdx : batchSelection)
+			{
+				const T *__restrict yTrue = data.BatchY(batchIdx);
+				const T *__restrict sw = sampleWeight ? sampleWeight->GetBatch(batchIdx) : nullptr;
+
+				T *entry = nullptr;
+				for (size_t k = 0; k < codes.size(); k++)
 				{
-					if (cw)
-					{
-						if (sw)
-							score = Utils::ComputeLogitApprox<T, true, true>(yTrue, yPred, BATCH, cw0, cw1, sw);
-						else
-							score = Utils::ComputeLogitApprox<T, true, false>(yTrue, yPred, BATCH, cw0, cw1);
-					}
-					else
+					if (!complete[k])
+						continue;
+					ExecuteBatch(mPrograms[k], parent, batchIdx, entry);
+					r[k]->Add(batchIdx, scoreBatch(yTrue, mPrograms[k].mOutput, sw, clipMin, clipMax, cw0, cw1));
+					if (abort && Reaches(*r[k], batchSelection.size(), bound))
 					{
-						if (sw)
-							score = Utils::ComputeLogitApprox<T, false, true>(yTrue, yPred, BATCH, cw0, cw1, sw);
-						else
-							score = Utils::ComputeLogitApprox<T, false, false>(yTrue, yPred, BATCH);
+						complete[k] = 0;
+						active--;
 					}
 				}
-				else
-				{
-					if (transformation)
-					{
-						Utils::TransformData<T, BATCH>(yPred, transformation);
-					}
+				if (!active)
+					break;
+			}
+		}
 
-					if (clip)
-					{
-						Utils::Clip<T, BATCH>(yPred, clipMin, clipMax);
-					}
+		// Predictions of the first batchCount batches are written to their y. With several threads each one
+		// computes a contiguous range of batches with its own program and memory, the batches don't depend
+		// on each other so the predictions are the same as computed by one thread. The threads are tasks of
+		// the thread pool, they run on the calling thread without one.
+		void Compute(Dataset &data, const Code<T> &code, uint32_t transformation, T clipMin, T clipMax, size_t batchCount, size_t threads = 1) noexcept
+		{
+			const Code<T> *codes[]{&code};
+			T *y[]{data.DataY()};
+			ComputeCodes(data, codes, y, 1, transformation, clipMin, clipMax, batchCount, threads);
+		}
 
-					// TODO: refactor and move to a separate class
-					if (metric == 0)
-					{
-						if (sw)
-							score = Utils::ComputeSqErr<T, true>(yTrue, yPred, BATCH, sw);
-						else
-							score = Utils::ComputeSqErr<T, false>(yTrue, yPred, BATCH);
-					}
-					else if (metric == 1)
-					{
-						if (sw)
-							score = Utils::ComputeMAE<T, true>(yTrue, yPred, BATCH, sw);
-						else
-							score = Utils::ComputeMAE<T, false>(yTrue, yPred, BATCH);
-					}
-					else if (metric == 2)
-					{
-						if (sw)
-							score = Utils::ComputeMSLE<T, true>(yTrue, yPred, BATCH, sw);
-						else
-							score = Utils::ComputeMSLE<T, false>(yTrue, yPred, BATCH);
-					}
-					else if (metric == 3)
-					{
-						score = 1.0 - std::abs(Utils::ComputePseudoKendall(yTrue, yPred, BATCH));
-					}
-					else if (metric == 4)
-					{
-						if (cw)
-						{
-							if (sw)
-								score = Utils::ComputeLogLoss<T, true, true>(yTrue, yPred, BATCH, cw0, cw1, sw);
-							else
-								score = Utils::ComputeLogLoss<T, true, false>(yTrue, yPred, BATCH, cw0, cw1);
-						}
-						else
-						{
-							if (sw)
-								score = Utils::ComputeLogLoss<T, false, true>(yTrue, yPred, BATCH, cw0, cw1, sw);
-							else
-								score = Utils::ComputeLogLoss<T, false, false>(yTrue, yPred, BATCH);
-						}
-					}
-				}
+		// Compute of several codes in one pass, each batch is computed by all the codes while its inputs are
+		// in cache. The predictions of codes[k] go to y[k], batchCount * BATCH values.
+		void Compute(const Dataset &data,
+					 const std::vector<const Code<T> *> &codes,
+					 const std::vector<T *> &y,
+					 uint32_t transformation,
+					 T clipMin,
+					 T clipMax,
+					 size_t batchCount,
+					 size_t threads = 1) noexcept
+		{
+			assert(codes.size() == y.size());
+			ComputeCodes(data, codes.data(), y.data(), codes.size(), transformation, clipMin, clipMax, batchCount, threads);
+		}
+
+	private:
+		// ComputeScore of a contiguous range of the selection per thread, each with its own program and memory.
+		// The parent cache isn't shared between threads and is left out, it doesn't change the outputs.
+		// The batch results are merged in selection order and summed again in that order, so the
+		// score doesn't depend on the thread count. With a bound the threads add up their batch scores and
+		// all of them stop once the sum reaches it.
+		bool ComputeScoreThreads(
+			const Dataset &data,
+			const Code<T> &code,
+			const std::vector<size_t> &batchSelection,
+			Utils::Result<BATCH> &r,
+			uint32_t transformation,
+			uint32_t metric,
+			T clipMin,
+			T clipMax,
+			T cw0,
+			T cw1,
+			const Utils::BatchVector<T, BATCH> *sampleWeight,
+			double bound,
+			bool fullPrecision,
+			size_t threads) noexcept
+		{
+			while (mPrograms.size() < threads)
+			{
+				mPrograms.emplace_back();
+				mMemories.push_back(std::make_unique<Memory<T, BATCH>>(mCodeSettings));
+			}
+			mThreadResults.resize(std::max(mThreadResults.size(), threads));
+			for (size_t t = 0; t < threads; t++)
+			{
+				mProcessor.Compile(code, data, *mMemories[t], mPrograms[t], nullptr, !fullPrecision);
+			}
+			const auto scoreBatch = mScoreBatch[ScoreIndex(metric, transformation, clipMin < clipMax, cw0 != cw1, sampleWeight != nullptr)];
+			const auto abort = bound != NO_BOUND && CanAbort(metric, transformation, clipMin, clipMax);
+			const auto count = batchSelection.size();
+			std::atomic<double> sum{0.0};
+			std::atomic<bool> reached{false};
+
+			mPool->ParallelFor(threads, [&](size_t t) noexcept
+							   {
+				const auto &p = mPrograms[t];
+				auto &tr = mThreadResults[t];
+				tr.Reset();
+				for (size_t i = count * t / threads; i < count * (t + 1) / threads; i++)
+				{
+					if (abort && reached.load(std::memory_order_relaxed))
+						return;
+					const auto batchIdx = batchSelection[i];
+					mProcessor.Execute(p, batchIdx);
+					const auto score = scoreBatch(data.BatchY(batchIdx), p.mOutput, sampleWeight ? sampleWeight->GetBatch(batchIdx) : nullptr, clipMin, clipMax, cw0, cw1);
+					tr.Add(batchIdx, score);
+					if (abort && (sum.fetch_add(score, std::memory_order_relaxed) + score) / (count * BATCH) >= bound)
+						reached.store(true, std::memory_order_relaxed);
+				} });
 
-				r.Add(batchIdx, score);
+			for (size_t t = 0; t < threads; t++)
+			{
+				for (const auto &bs : mThreadResults[t].mScore)
+					r.Add(bs.mIndex, bs.mScore);
 			}
+			return !reached.load(std::memory_order_relaxed);
 		}
 
-		void Compute(Dataset &data, const Code<T> &code, uint32_t transformation, T clipMin, T clipMax, bool filter = false) noexcept
+		void ComputeCodes(const Dataset &data, const Code<T> *const *codes, T *const *y, size_t count, uint32_t transformation, T clipMin, T clipMax, size_t batchCount, size_t threads) noexcept
 		{
-			T *__restrict yPred = mMemory[code.Size() - 1];
-			const auto clip = clipMin < clipMax;
+			assert(batchCount <= data.BatchCount());
+			if (!batchCount || !count)
+				return;
+			threads = std::clamp<size_t>(threads, 1, std::min(batchCount, mPool ? mPool->Size() : 1));
 
-			for (size_t batchIdx = 0; batchIdx < data.BatchCount(); batchIdx++)
+			while (mPrograms.size() < threads * count)
 			{
-				mProcessor.Execute(code, data, mMemory, batchIdx, filter);
-
-				if (transformation)
+				mPrograms.emplace_back();
+				mMemories.push_back(std::make_unique<Memory<T, BATCH>>(mCodeSettings));
+			}
+			for (size_t t = 0; t < threads; t++)
+			{
+				for (size_t k = 0; k < count; k++)
 				{
-					Utils::TransformData<T, BATCH>(yPred, transformation);
+					mProcessor.Compile(*codes[k], data, *mMemories[t * count + k], mPrograms[t * count + k]);
 				}
+			}
 
-				if (clip)
+			const auto run = [&, threads](size_t t) noexcept
+			{
+				const auto *programs = &mPrograms[t * count];
+				for (size_t batchIdx = batchCount * t / threads; batchIdx < batchCount * (t + 1) / threads; batchIdx++)
 				{
-					Utils::Clip<T, BATCH>(yPred, clipMin, clipMax);
+					for (size_t k = 0; k < count; k++)
+					{
+						mProcessor.Execute(programs[k], batchIdx);
+						mFinishBatch(programs[k].mOutput, y[k] + batchIdx * BATCH, transformation, clipMin, clipMax);
+					}
 				}
+			};
+			if (mPool)
+			{
+				mPool->ParallelFor(threads, run);
+				return;
+			}
+			for (size_t t = 0; t < threads; t++)
+			{
+				run(t);
+			}
+		}
 
-				T *const __restrict y2 = data.BatchY(batchIdx);
-				for (size_t n = 0; n < BATCH; n++)
+		// the parent's cache entry of the batch is looked up, or filled, by the first program reading it. Only
+		// programs compiled against a parent use the cache, checking parent too keeps its fill off the path without one
+		void ExecuteBatch(const Program<T> &p, CachedParent<T> *parent, size_t batchIdx, T *&entry) noexcept
+		{
+			if (parent && p.mUsesCache && !entry)
+			{
+				entry = mCache.Find(mParent, batchIdx);
+				if (!entry)
 				{
-					y2[n] = yPred[n];
+					entry = mCache.Insert(mParent, batchIdx);
+					mProcessor.Execute(parent->mFill, batchIdx, entry);
 				}
 			}
+			mProcessor.Execute(p, batchIdx, entry);
 		}
 
-	private:
+		using ScoreKernel = double (*)(const T *, T *, const T *, T, T, T, T) noexcept;
+		using FinishKernel = void (*)(T *, T *, uint32_t, T, T) noexcept;
+
+		constexpr static size_t NO_PARENT = std::numeric_limits<size_t>::max();
+
+		// Batch scores only add up, so once the partial sum divided like Result::Mean divides the full one
+		// reaches the bound the full mean does too. Log loss is only non negative for predictions in [0, 1],
+		// logit approximation can be negative. Sample and class weights are assumed non negative.
+		static bool CanAbort(uint32_t metric, uint32_t transformation, T clipMin, T clipMax) noexcept
+		{
+			if (metric <= Utils::METRIC_KENDALL)
+				return true;
+			if (metric == Utils::METRIC_LOG_LOSS)
+				return (transformation == 1 || transformation == 2) && (clipMin >= clipMax || (clipMin >= 0 && clipMax <= 1));
+			return false;
+		}
+
+		static bool Reaches(const Utils::Result<BATCH> &r, size_t batchCount, double bound) noexcept
+		{
+			return r.mScoreSum / (batchCount * BATCH) >= bound;
+		}
+
+		// batches of a selection per thread below which ComputeScore runs on the calling thread
+		constexpr static size_t MIN_THREAD_BATCHES = 64;
+
+		// one fused scoring kernel per (metric, transformation, clip, class weight, sample weight), the
+		// metric slots are 0 - 4, logit approximation and unknown metrics
+		constexpr static size_t METRIC_SLOTS = 7;
+		constexpr static size_t SCORE_KERNELS = METRIC_SLOTS * 4 * 2 * 2 * 2;
+
+		static size_t ScoreIndex(uint32_t metric, uint32_t transformation, bool clip, bool cw, bool sw) noexcept
+		{
+			size_t m = 6;
+			if (metric <= Utils::METRIC_LOG_LOSS)
+				m = metric;
+			else if (metric == Utils::METRIC_LOGIT_APPROX)
+				m = 5;
+			const size_t t = transformation <= 3 ? transformation : 0;
+			return (((m * 4 + t) * 2 + clip) * 2 + cw) * 2 + sw;
+		}
+
+		constexpr static uint32_t SlotMetric(size_t slot) noexcept
+		{
+			if (slot <= Utils::METRIC_LOG_LOSS)
+				return static_cast<uint32_t>(slot);
+			return slot == 5 ? Utils::METRIC_LOGIT_APPROX : std::numeric_limits<uint32_t>::max();
+		}
+
+		// flags a metric ignores are dropped, so equivalent combinations share one instantiation
+		template <Utils::Isa ISA, size_t I>
+		constexpr static ScoreKernel MakeScoreKernel() noexcept
+		{
+			constexpr auto metric = SlotMetric(I / 32);
+			constexpr auto logit = metric == Utils::METRIC_LOGIT_APPROX;
+			constexpr uint32_t transformation = logit ? 0 : (I / 8) % 4;
+			constexpr bool clip = !logit && (I & 4) != 0;
+			constexpr bool cw = (logit || metric == Utils::METRIC_LOG_LOSS) && (I & 2) != 0;
+			constexpr bool sw = metric != Utils::METRIC_MAE && metric != Utils::METRIC_KENDALL && (I & 1) != 0;
+			if constexpr (ISA == Utils::Isa::Avx512)
+				return &ScoreBatchAvx512<metric, transformation, clip, cw, sw>;
+			else if constexpr (ISA == Utils::Isa::Avx2)
+				return &ScoreBatchAvx2<metric, transformation, clip, cw, sw>;
+			else
+				return &ScoreBatchSse42<metric, transformation, clip, cw, sw>;
+		}
+
+		template <size_t... I>
+		constexpr static auto MakeScoreKernels(std::index_sequence<I...>) noexcept
+		{
+			return std::array<std::array<ScoreKernel, sizeof...(I)>, Utils::ISA_COUNT>{{
+				{MakeScoreKernel<Utils::Isa::Sse42, I>()...},
+				{MakeScoreKernel<Utils::Isa::Avx2, I>()...},
+				{MakeScoreKernel<Utils::Isa::Avx512, I>()...}}};
+		}
+
+		ALWAYS_INLINE static void FinishBatch(T *__restrict yPred, T *__restrict y, uint32_t transformation, T clipMin, T clipMax) noexcept
+		{
+			if (transformation)
+			{
+				Utils::TransformData<T, BATCH>(yPred, transformation);
+			}
+
+			if (clipMin < clipMax)
+			{
+				Utils::Clip<T, BATCH>(yPred, clipMin, clipMax);
+			}
+
+			for (size_t n = 0; n < BATCH; n++)
+			{
+				y[n] = yPred[n];
+			}
+		}
+
+#define DEF_ISA_KERNELS(ISA, TARGET)                                                                            \
+    template <uint32_t METRIC, uint32_t TRANSFORMATION, bool CLIP, bool CW, bool SW>                            \
+    TARGET static double ScoreBatch##ISA(const T *yTrue, T *yPred, const T *sw,                                 \
+                                         T clipMin, T clipMax, T cw0, T cw1) noexcept                           \
+    {                                                                                                           \
+        return Utils::ScoreFused<T, BATCH, METRIC, TRANSFORMATION, CLIP, CW, SW>(yTrue, yPred, sw,              \
+                                                                                 clipMin, clipMax, cw0, cw1);   \
+    }                                                                                                           \
+    TARGET static void FinishBatch##ISA(T *yPred, T *y, uint32_t transformation, T clipMin, T clipMax) noexcept \
+    {                                                                                                           \
+        FinishBatch(yPred, y, transformation, clipMin, clipMax);                                                \
+    }
+
+		DEF_ISA_KERNELS(Sse42, TARGET_SSE42)
+		DEF_ISA_KERNELS(Avx2, TARGET_AVX2)
+		DEF_ISA_KERNELS(Avx512, TARGET_AVX512)
+
+#undef DEF_ISA_KERNELS
+
+		constexpr static auto mScoreKernels{MakeScoreKernels(std::make_index_sequence<SCORE_KERNELS>())};
+		constexpr static std::array<FinishKernel, Utils::ISA_COUNT> mFinishKernels{&FinishBatchSse42, &FinishBatchAvx2, &FinishBatchAvx512};
+
 		const CodeSettings mCodeSettings{};
 		Memory<T, BATCH> mMemory{};
 		Processor<T, BATCH> mProcessor{};
+		Program<T> mProgram{};
+		std::vector<Program<T>> mPrograms{}; // ComputeScores, one per code, Compute, one per thread and code, ComputeScoreThreads, one per thread
+		std::vector<std::unique_ptr<Memory<T, BATCH>>> mMemories{};
+		std::vector<Utils::Result<BATCH>> mThreadResults{};
+		EvalCache<T, BATCH> mCache;
+		Program<T> mRepair{};
+		std::vector<size_t> mRepairOffset{};
+		size_t mParent{NO_PARENT};
+		const ScoreKernel *const mScoreBatch;
+		const FinishKernel mFinishBatch;
+		Utils::ThreadPool *mPool{nullptr};
 	};
 }
\ No newline at end of file
@@ -2,184 +2,549 @@
 
 #include "Code.h"
 #include "Memory.h"
+#include "Program.h"
+#include "EvalCache.h"
 #include "../Utils/Dataset.h"
+#include "../Utils/Cpu.h"
 
 namespace SymbolicRegression::Computer
 {
     template <typename T, size_t BATCH>
     struct Processor
     {
-        constexpr static size_t INSTRUCTIONS_COUNT_LIMIT = 64;
         constexpr static size_t INSTRUCTIONS_COUNT{std::tuple_size<Instructions::Set>()};
-        static_assert(INSTRUCTIONS_COUNT < INSTRUCTIONS_COUNT_LIMIT);
 
-        static constexpr Instructions::Set mInstructions{};
         const CodeSettings mCodeSettings;
+        const Utils::Isa mIsa;
 
-        explicit Processor(const CodeSettings &cs) noexcept
-            : mCodeSettings(cs)
+        Processor(const CodeSettings &cs, Utils::Isa isa) noexcept
+            : mCodeSettings(cs),
+              mIsa(isa)
         {
         }
 
         template <typename INSTR>
-        void Execute(INSTR &&_i,
-                     const T *src1,
-                     const T *src2,
-                     T *__restrict dst) const noexcept
+        ALWAYS_INLINE static void Execute(INSTR &&_i,
+                                          const T *src1,
+                                          const T *src2,
+                                          T *__restrict dst) noexcept
         {
             for (size_t n = 0; n < BATCH; n++)
                 dst[n] = _i(src1[n], src2[n]);
         }
 
         template <typename INSTR>
-        void Execute(INSTR &&_i,
-                     const T *src1,
-                     const T src2,
-                     T *__restrict dst) const noexcept
+        ALWAYS_INLINE static void Execute(INSTR &&_i,
+                                          const T *src1,
+                                          const T src2,
+                                          T *__restrict dst) noexcept
         {
             for (size_t n = 0; n < BATCH; n++)
                 dst[n] = _i(src1[n], src2);
         }
 
         template <typename INSTR>
-        void Execute(INSTR &&_i,
-                     const T src1,
-                     const T *src2,
-                     T *__restrict dst) const noexcept
+        ALWAYS_INLINE static void Execute(INSTR &&_i,
+                                          const T src1,
+                                          const T *src2,
+                                          T *__restrict dst) noexcept
         {
             for (size_t n = 0; n < BATCH; n++)
                 dst[n] = _i(src1, src2[n]);
         }
 
         template <typename INSTR>
-        void Execute(INSTR &&_i,
-                     const T src1,
-                     const T src2,
-                     T *__restrict dst) const noexcept
+        ALWAYS_INLINE static void Execute(INSTR &&_i,
+                                          const T src1,
+                                          const T src2,
+                                          T *__restrict dst) noexcept
         {
             for (size_t n = 0; n < BATCH; n++)
                 dst[n] = _i(src1, src2);
         }
 
-        void Execute(const Code<T> &c,
-            const Utils::Dataset<T, BATCH> &data,
-            Memory<T, BATCH> &mem,
-            size_t batchIndex,
-            bool filter = false) const noexcept
+        // C1/C2 select the scalar overload, constant operands point to a single value
+        template <typename INSTR, bool C1, bool C2>
+        ALWAYS_INLINE static void Run(const T *src1, const T *src2, T *__restrict dst) noexcept
         {
+            constexpr INSTR _i{};
+            if constexpr (C1 && C2)
+                Execute(_i, *src1, *src2, dst);
+            else if constexpr (C1)
+                Execute(_i, *src1, src2, dst);
+            else if constexpr (C2)
+                Execute(_i, src1, *src2, dst);
+            else
+                Execute(_i, src1, src2, dst);
+            if constexpr (requires { INSTR::RANGE; })
+                ExactBeyondRange<INSTR, C1>(src1, dst);
+        }
+
+        // The operands the code of INSTR isn't accurate for are recomputed with its exact code. They are
+        // rare, the batch is only scanned for them so the loop above stays vectorized.
+        template <typename INSTR, bool C1>
+        ALWAYS_INLINE static void ExactBeyondRange(const T *src1, T *__restrict dst) noexcept
+        {
+            constexpr auto range = static_cast<T>(INSTR::RANGE);
+            if constexpr (C1)
+            {
+                if (std::abs(*src1) >= range)
+                    std::fill(dst, dst + BATCH, INSTR::Exact(*src1));
+            }
+            else
+            {
+                uint32_t beyond = 0;
+                for (size_t n = 0; n < BATCH; n++)
+                    beyond |= std::abs(src1[n]) >= range;
+                for (size_t n = 0; n < BATCH && beyond; n++)
+                {
+                    if (std::abs(src1[n]) >= range)
+                        dst[n] = INSTR::Exact(src1[n]);
+                }
+            }
+        }
+
+        template <typename INSTR, bool C1, bool C2>
+        TARGET_SSE42 static void RunSse42(const T *src1, const T *src2, T *__restrict dst) noexcept
+        {
+            Run<INSTR, C1, C2>(src1, src2, dst);
+        }
+
+        template <typename INSTR, bool C1, bool C2>
+        TARGET_AVX2 static void RunAvx2(const T *src1, const T *src2, T *__restrict dst) noexcept
+        {
+            Run<INSTR, C1, C2>(src1, src2, dst);
+        }
+
+        template <typename INSTR, bool C1, bool C2>
+        TARGET_AVX512 static void RunAvx512(const T *src1, const T *src2, T *__restrict dst) noexcept
+        {
+            Run<INSTR, C1, C2>(src1, src2, dst);
+        }
+
+        using Folder = T (*)(T, T) noexcept;
+
+        template <typename INSTR>
+        static T Fold(T src1, T src2) noexcept
+        {
+            constexpr INSTR _i{};
+            if constexpr (requires { INSTR::RANGE; })
+            {
+                if (std::abs(src1) >= static_cast<T>(INSTR::RANGE))
+                    return INSTR::Exact(src1);
+            }
+            return _i(src1, src2);
+        }
+
+        template <Utils::Isa ISA, size_t I>
+        constexpr static Kernel<T> MakeKernel() noexcept
+        {
+            using INSTR = std::tuple_element_t<I / 4, Instructions::Set>;
+            constexpr auto c1 = (I & 2) != 0;
+            constexpr auto c2 = (I & 1) != 0;
+            if constexpr (ISA == Utils::Isa::Avx512)
+                return &RunAvx512<INSTR, c1, c2>;
+            else if constexpr (ISA == Utils::Isa::Avx2)
+                return &RunAvx2<INSTR, c1, c2>;
+            else
+                return &RunSse42<INSTR, c1, c2>;
+        }
+
+        template <size_t... I>
+        constexpr static auto MakeKernels(std::index_sequence<I...>) noexcept
+        {
+            return std::array<std::array<Kernel<T>, sizeof...(I)>, Utils::ISA_COUNT>{{
+                {MakeKernel<Utils::Isa::Sse42, I>()...},
+                {MakeKernel<Utils::Isa::Avx2, I>()...},
+                {MakeKernel<Utils::Isa::Avx512, I>()...}}};
+        }
+
+        template <size_t... I>
+        constexpr static auto MakeFolders(std::index_sequence<I...>) noexcept
+        {
+            return std::array<Folder, sizeof...(I)>{&Fold<std::tuple_element_t<I, Instructions::Set>>...};
+        }
+
+        template <size_t... I>
+        constexpr static auto MakeOperands(std::index_sequence<I...>) noexcept
+        {
+            return std::array<uint32_t, sizeof...(I)>{std::tuple_element_t<I, Instructions::Set>::operands...};
+        }
+
+        template <Utils::Storage S>
+        ALWAYS_INLINE static void WidenBatch(const uint16_t *__restrict src, T *__restrict dst) noexcept
+        {
+            for (size_t n = 0; n < BATCH; n++)
+                dst[n] = static_cast<T>(S == Utils::Storage::Fp16 ? Utils::HalfToFloat(src[n]) : Utils::Bf16ToFloat(src[n]));
+        }
+
+        template <Utils::Storage S>
+        TARGET_SSE42 static void WidenSse42(const uint16_t *__restrict src, T *__restrict dst) noexcept
+        {
+            WidenBatch<S>(src, dst);
+        }
+
+        template <Utils::Storage S>
+        TARGET_AVX2 static void WidenAvx2(const uint16_t *__restrict src, T *__restrict dst) noexcept
+        {
+#if defined(HAS_F16C)
+            if constexpr (S == Utils::Storage::Fp16)
+            {
+                static_assert(BATCH % 8 == 0);
+                for (size_t n = 0; n < BATCH; n += 8)
+                {
+                    const auto v = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + n)));
+                    if constexpr (std::is_same_v<T, float>)
+                    {
+                        _mm256_storeu_ps(dst + n, v);
+                    }
+                    else
+                    {
+                        _mm256_storeu_pd(dst + n, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+                        _mm256_storeu_pd(dst + n + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+                    }
+                }
+                return;
+            }
+#endif
+            WidenBatch<S>(src, dst);
+        }
+
+        template <Utils::Storage S>
+        TARGET_AVX512 static void WidenAvx512(const uint16_t *__restrict src, T *__restrict dst) noexcept
+        {
+            WidenAvx2<S>(src, dst);
+        }
+
+        // per ISA, fp16 and bf16
+        constexpr static std::array<std::array<Widen<T>, 2>, Utils::ISA_COUNT> mWidens{{
+            {&WidenSse42<Utils::Storage::Fp16>, &WidenSse42<Utils::Storage::Bf16>},
+            {&WidenAvx2<Utils::Storage::Fp16>, &WidenAvx2<Utils::Storage::Bf16>},
+            {&WidenAvx512<Utils::Storage::Fp16>, &WidenAvx512<Utils::Storage::Bf16>}}};
+
+        // per ISA, kernel for opcode op is at op * 4 + const(src1) * 2 + const(src2)
+        constexpr static auto mKernels{MakeKernels(std::make_index_sequence<INSTRUCTIONS_COUNT * 4>())};
+        constexpr static auto mFolders{MakeFolders(std::make_index_sequence<INSTRUCTIONS_COUNT>())};
+        constexpr static auto mOperands{MakeOperands(std::make_index_sequence<INSTRUCTIONS_COUNT>())};
+
+        // Without a parent every live instruction is computed. With one, instructions whose inputs and
+        // constants match the parent are read from the parent's cache entry of the batch instead and only
+        // the changed cone below the output is executed. Constant-only instructions are folded to scalars
+        // here and their readers use the scalar operand kernels.
+        void Compile(const Code<T> &c,
+                     const Utils::Dataset<T, BATCH> &data,
+                     Memory<T, BATCH> &mem,
+                     Program<T> &p,
+                     const CachedParent<T> *parent = nullptr,
+                     bool compact = false) const noexcept
+        {
+            p.Clear();
+            const auto unused = CopyConstants(c, p);
+            PrepareLoads(c, data, p, compact);
+
+            auto &folded = p.mFolded;
+            FoldConstants(c, p);
+
+            auto &cacheOffset = p.mCacheOffset;
+            cacheOffset.assign(c.Size(), NO_CACHE);
+            if (parent)
+                MatchParent(c, *parent, cacheOffset);
+
+            auto &lastUse = p.mLastUse;
+            MarkLive(c, cacheOffset, folded, lastUse);
+
+            auto &slot = p.mSlot;
+            auto &freeSlots = p.mFreeSlots;
+            slot.resize(c.Size());
+            freeSlots.clear();
+
+            const auto codeStart = mCodeSettings.CodeStart();
+            const auto resolve = [&](const Instruction &instr, uint32_t j) noexcept -> Operand<T>
+            {
+                if (!IsMemory(instr, j))
+                    return ResolveOther(instr, j, data, p, unused);
+                const auto src = instr.mSrc[j] - codeStart;
+                if (folded[src] != Program<T>::NOT_FOLDED)
+                    return {&p.mConstants[folded[src]], 0};
+                if (cacheOffset[src] != NO_CACHE)
+                {
+                    p.mUsesCache = true;
+                    return {nullptr, 0, cacheOffset[src]};
+                }
+                return {mem[slot[src]], 0};
+            };
+
+            for (size_t i = 0; i < c.Size(); i++)
+            {
+                // a folded output still has to be broadcast into its slot
+                const auto output = i + 1 == c.Size();
+                if (lastUse[i] == Program<T>::NOT_LIVE || cacheOffset[i] != NO_CACHE || (folded[i] != Program<T>::NOT_FOLDED && !output))
+                    continue;
+                const auto &instr = c[i];
+
+                // the destination is taken before the sources are released, kernels require dst not to alias them
+                if (freeSlots.empty())
+                {
+                    slot[i] = p.mSlotCount++;
+                }
+                else
+                {
+                    slot[i] = freeSlots.back();
+                    freeSlots.pop_back();
+                }
+
+                if (folded[i] != Program<T>::NOT_FOLDED)
+                {
+                    const auto *value = &p.mConstants[folded[i]];
+                    p.mSteps.push_back({GetKernel(Instructions::InstructionID::nop, true, true), {{value, 0}, {unused, 0}}, mem[slot[i]]});
+                    continue;
+                }
+
+                const auto isConst = [&](uint32_t j) noexcept
+                {
+                    return IsMemory(instr, j) ? folded[instr.mSrc[j] - codeStart] != Program<T>::NOT_FOLDED : IsConst(instr, j);
+                };
+                p.mSteps.push_back({GetKernel(instr.mOpCode, isConst(0), isConst(1)), {resolve(instr, 0), resolve(instr, 1)}, mem[slot[i]]});
+
+                for (uint32_t j = 0; j < 2; j++)
+                {
+                    if (!IsMemory(instr, j))
+                        continue;
+                    const auto src = instr.mSrc[j] - codeStart;
+                    const auto duplicate = j == 1 && IsMemory(instr, 0) && instr.mSrc[0] == instr.mSrc[1];
+                    if (cacheOffset[src] == NO_CACHE && folded[src] == Program<T>::NOT_FOLDED && lastUse[src] == i && !duplicate)
+                        freeSlots.push_back(slot[src]);
+                }
+            }
+            p.mOutput = mem[slot[c.Size() - 1]];
+        }
+
+        // Program storing every live instruction of c except the output into a cache entry, instruction i goes
+        // to offset i * BATCH and offset is filled for MatchParent. With old, the entry already holds the
+        // intermediates of old and only the instructions that differ from it are executed.
+        void CompileFill(const Code<T> &c,
+                         const Utils::Dataset<T, BATCH> &data,
+                         const CachedParent<T> *old,
+                         Program<T> &p,
+                         std::vector<size_t> &offset,
+                         bool compact = false) const noexcept
+        {
+            p.Clear();
+            const auto unused = CopyConstants(c, p);
+            PrepareLoads(c, data, p, compact);
+
+            auto &cacheOffset = p.mCacheOffset;
+            cacheOffset.assign(c.Size(), NO_CACHE);
+            if (old)
+                MatchParent(c, *old, cacheOffset);
+
+            // every live instruction ends up stored, so the liveness ignores what old already holds
+            auto &lastUse = p.mLastUse;
+            offset.assign(c.Size(), NO_CACHE);
+            p.mFolded.assign(c.Size(), Program<T>::NOT_FOLDED);
+            MarkLive(c, offset, p.mFolded, lastUse);
+
+            for (size_t i = 0; i + 1 < c.Size(); i++)
+            {
+                if (lastUse[i] == Program<T>::NOT_LIVE)
+                    continue;
+                offset[i] = i * BATCH;
+                if (cacheOffset[i] != NO_CACHE)
+                    continue;
+
+                const auto &instr = c[i];
+                const auto resolve = [&](uint32_t j) noexcept -> Operand<T>
+                {
+                    if (!IsMemory(instr, j))
+                        return ResolveOther(instr, j, data, p, unused);
+                    return {nullptr, 0, (instr.mSrc[j] - mCodeSettings.CodeStart()) * BATCH};
+                };
+                p.mSteps.push_back({GetKernel(instr), {resolve(0), resolve(1)}, nullptr, offset[i]});
+            }
+            p.mUsesCache = true;
+        }
+
+        ALWAYS_INLINE void Execute(const Step<T> &s, size_t batchIndex, T *cacheEntry = nullptr) const noexcept
+        {
+            const auto at = [&](const Operand<T> &o) noexcept -> const T *
+            {
+                return o.mCacheOffset == NO_CACHE ? o.mPtr + o.mStride * batchIndex : cacheEntry + o.mCacheOffset;
+            };
+            s.mKernel(at(s.mSrc[0]),
+                      at(s.mSrc[1]),
+                      s.mDstCacheOffset == NO_CACHE ? s.mDst : cacheEntry + s.mDstCacheOffset);
+        }
+
+        void Load(const Program<T> &p, size_t batchIndex) const noexcept
+        {
+            for (const auto &l : p.mLoads)
+                p.mWiden(l.mSrc + batchIndex * BATCH, l.mDst);
+        }
+
+        void Execute(const Program<T> &p, size_t batchIndex, T *cacheEntry = nullptr) const noexcept
+        {
+            Load(p, batchIndex);
+            for (const auto &s : p.mSteps)
+                Execute(s, batchIndex, cacheEntry);
+        }
+
+    private:
+        ALWAYS_INLINE bool IsMemory(const Instruction &instr, uint32_t j) const noexcept
+        {
+            return j < mOperands[static_cast<uint32_t>(instr.mOpCode)] && !instr.mConst[j] && instr.mSrc[j] >= mCodeSettings.CodeStart();
+        }
+
+        // constant or unused operand, not valid for memory operands
+        ALWAYS_INLINE bool IsConst(const Instruction &instr, uint32_t j) const noexcept
+        {
+            return j >= mOperands[static_cast<uint32_t>(instr.mOpCode)] || instr.mConst[j];
+        }
+
+        Kernel<T> GetKernel(Instructions::InstructionID op, bool c1, bool c2) const noexcept
+        {
+            return mKernels[Utils::IsaIndex(mIsa)][static_cast<uint32_t>(op) * 4 + c1 * 2 + c2];
+        }
+
+        Kernel<T> GetKernel(const Instruction &instr) const noexcept
+        {
+            return GetKernel(instr.mOpCode, IsConst(instr, 0), IsConst(instr, 1));
+        }
+
+        // copies the constants, one extra zero constant stands in for the unused operand of unary instructions
+        static const T *CopyConstants(const Code<T> &c, Program<T> &p) noexcept
+        {
+            // room for the folded instructions too, operands keep pointers into mConstants
+            p.mConstants.reserve(c.mConstants.size() + 1 + c.Size());
+            p.mConstants.assign(c.mConstants.begin(), c.mConstants.end());
+            p.mConstants.push_back(static_cast<T>(0.0));
+            return &p.mConstants.back();
+        }
+
+        Operand<T> ResolveOther(const Instruction &instr,
+                                uint32_t j,
+                                const Utils::Dataset<T, BATCH> &data,
+                                Program<T> &p,
+                                const T *unused) const noexcept
+        {
+            if (j >= mOperands[static_cast<uint32_t>(instr.mOpCode)])
+                return {unused, 0};
+            if (instr.mConst[j])
+                return {&p.mConstants[instr.mSrc[j]], 0};
+            if (p.mStorage != Utils::Storage::Full)
+                return {Stage(data, p, instr.mSrc[j]), 0};
+            return {data.DataX(instr.mSrc[j]), BATCH};
+        }
+
+        // With compact set and a compact dataset the program reads its inputs from the staging buffer,
+        // Load widens them there at the start of each batch.
+        void PrepareLoads(const Code<T> &c, const Utils::Dataset<T, BATCH> &data, Program<T> &p, bool compact) const noexcept
+        {
+            if (!compact || data.GetStorage() == Utils::Storage::Full)
+                return;
+            p.mStorage = data.GetStorage();
+            p.mWiden = mWidens[Utils::IsaIndex(mIsa)][p.mStorage == Utils::Storage::Fp16 ? 0 : 1];
+            p.mLoadOf.assign(data.CountX(), Program<T>::NO_LOAD);
+            // at most two inputs per instruction, sized up front as steps keep pointers into it
+            if (p.mStaging.size() < 2 * c.Size() * BATCH)
+                p.mStaging.resize(2 * c.Size() * BATCH);
+        }
+
+        T *Stage(const Utils::Dataset<T, BATCH> &data, Program<T> &p, uint32_t x) const noexcept
+        {
+            auto &load = p.mLoadOf[x];
+            if (load == Program<T>::NO_LOAD)
+            {
+                load = static_cast<uint32_t>(p.mLoads.size());
+                p.mLoads.push_back({data.CompactX(x), p.mStaging.data() + load * BATCH});
+            }
+            return p.mLoads[load].mDst;
+        }
+
+        // every operand is a constant, unused or a folded instruction, evaluated once per program
+        void FoldConstants(const Code<T> &c, Program<T> &p) const noexcept
+        {
+            const auto codeStart = mCodeSettings.CodeStart();
+            auto &folded = p.mFolded;
+            folded.assign(c.Size(), Program<T>::NOT_FOLDED);
             for (size_t i = 0; i < c.Size(); i++)
             {
                 const auto &instr = c[i];
-                if (filter && !instr.mUsed)
+                T value[2]{};
+                auto constant = true;
+                for (uint32_t j = 0; j < 2 && constant; j++)
+                {
+                    if (IsMemory(instr, j))
+                    {
+                        const auto src = instr.mSrc[j] - codeStart;
+                        constant = folded[src] != Program<T>::NOT_FOLDED;
+                        if (constant)
+                            value[j] = p.mConstants[folded[src]];
+                    }
+                    else if (j < mOperands[static_cast<uint32_t>(instr.mOpCode)])
+                    {
+                        constant = instr.mConst[j];
+                        if (constant)
+                            value[j] = p.mConstants[instr.mSrc[j]];
+                    }
+                }
+                if (!constant)
+                    continue;
+                folded[i] = static_cast<uint32_t>(p.mConstants.size());
+                p.mConstants.push_back(mFolders[static_cast<uint32_t>(instr.mOpCode)](value[0], value[1]));
+            }
+        }
+
+        // backward walk from the output, the first reader met is the last one to run,
+        // instructions read from the cache or folded need none of their sources
+        void MarkLive(const Code<T> &c,
+                      const std::vector<size_t> &cacheOffset,
+                      const std::vector<uint32_t> &folded,
+                      std::vector<uint32_t> &lastUse) const noexcept
+        {
+            const auto codeStart = mCodeSettings.CodeStart();
+            lastUse.assign(c.Size(), Program<T>::NOT_LIVE);
+            lastUse[c.Size() - 1] = static_cast<uint32_t>(c.Size());
+            for (size_t i = c.Size(); i-- > 0;)
+            {
+                if (lastUse[i] == Program<T>::NOT_LIVE || cacheOffset[i] != NO_CACHE || folded[i] != Program<T>::NOT_FOLDED)
+                    continue;
+                const auto &instr = c[i];
+                for (uint32_t j = 0; j < 2; j++)
+                {
+                    if (IsMemory(instr, j) && lastUse[instr.mSrc[j] - codeStart] == Program<T>::NOT_LIVE)
+                        lastUse[instr.mSrc[j] - codeStart] = static_cast<uint32_t>(i);
+                }
+            }
+        }
+
+        // an instruction is clean when the parent stored it and its opcode, operands and constants are
+        // unchanged, memory operands must be clean themselves, the output is always recomputed
+        void MatchParent(const Code<T> &c, const CachedParent<T> &parent, std::vector<size_t> &cacheOffset) const noexcept
+        {
+            const auto codeStart = mCodeSettings.CodeStart();
+            const auto size = std::min(c.Size(), parent.mCode.Size());
+            for (size_t i = 0; i + 1 < size; i++)
+            {
+                if (parent.mOffset[i] == NO_CACHE)
+                    continue;
+                const auto &instr = c[i];
+                const auto &old = parent.mCode[i];
+                if (instr.mOpCode != old.mOpCode)
                     continue;
 
-                T *__restrict dst = mem[i];
-
-                const auto src0 = instr.mSrc[0] - mCodeSettings.CodeStart();
-                const auto src1 = instr.mSrc[1] - mCodeSettings.CodeStart();
-
-#define __handle_op(x)                                                                                                          \
-    case x:                                                                                                                     \
-        if constexpr ((x) < INSTRUCTIONS_COUNT)                                                                                 \
-        {                                                                                                                       \
-            const auto &_i = std::get<((x) < INSTRUCTIONS_COUNT ? (x) : 0)>(mInstructions);                                     \
-            if (!instr.mConst[0] && !instr.mConst[1])                                                                           \
-            {                                                                                                                   \
-                const T *_src1 = instr.mSrc[0] < mCodeSettings.mInputSize ? data.BatchX(instr.mSrc[0], batchIndex) : mem[src0]; \
-                const T *_src2 = instr.mSrc[1] < mCodeSettings.mInputSize ? data.BatchX(instr.mSrc[1], batchIndex) : mem[src1]; \
-                Execute(_i, _src1, _src2, dst);                                                                                 \
-            }                                                                                                                   \
-            else if (instr.mConst[0] && instr.mConst[1])                                                                        \
-            {                                                                                                                   \
-                const T c_src1 = c.mConstants[instr.mSrc[0]];                                                                   \
-                const T c_src2 = c.mConstants[instr.mSrc[1]];                                                                   \
-                Execute(_i, c_src1, c_src2, dst);                                                                               \
-            }                                                                                                                   \
-            else if (instr.mConst[0] && !instr.mConst[1])                                                                       \
-            {                                                                                                                   \
-                const T *_src2 = instr.mSrc[1] < mCodeSettings.mInputSize ? data.BatchX(instr.mSrc[1], batchIndex) : mem[src1]; \
-                const T c_src1 = c.mConstants[instr.mSrc[0]];                                                                   \
-                Execute(_i, c_src1, _src2, dst);                                                                                \
-            }                                                                                                                   \
-            else if (!instr.mConst[0] && instr.mConst[1])                                                                       \
-            {                                                                                                                   \
-                const T *_src1 = instr.mSrc[0] < mCodeSettings.mInputSize ? data.BatchX(instr.mSrc[0], batchIndex) : mem[src0]; \
-                const T c_src2 = c.mConstants[instr.mSrc[1]];                                                                   \
-                Execute(_i, _src1, c_src2, dst);                                                                                \
-            }                                                                                                                   \
-        }                                                                                                                       \
-        break
-
-                switch (static_cast<uint32_t>(instr.mOpCode))
+                auto clean = true;
+                for (uint32_t j = 0; j < mOperands[static_cast<uint32_t>(instr.mOpCode)]; j++)
                 {
-                    __handle_op(0);
-                    __handle_op(1);
-                    __handle_op(2);
-                    __handle_op(3);
-                    __handle_op(4);
-                    __handle_op(5);
-                    __handle_op(6);
-                    __handle_op(7);
-                    __handle_op(8);
-                    __handle_op(9);
-                    __handle_op(10);
-                    __handle_op(11);
-                    __handle_op(12);
-                    __handle_op(13);
-                    __handle_op(14);
-                    __handle_op(15);
-                    __handle_op(16);
-                    __handle_op(17);
-                    __handle_op(18);
-                    __handle_op(19);
-                    __handle_op(20);
-                    __handle_op(21);
-                    __handle_op(22);
-                    __handle_op(23);
-                    __handle_op(24);
-                    __handle_op(25);
-                    __handle_op(26);
-                    __handle_op(27);
-                    __handle_op(28);
-                    __handle_op(29);
-                    __handle_op(30);
-                    __handle_op(31);
-                    __handle_op(32);
-                    __handle_op(33);
-                    __handle_op(34);
-                    __handle_op(35);
-                    __handle_op(36);
-                    __handle_op(37);
-                    __handle_op(38);
-                    __handle_op(39);
-                    __handle_op(40);
-                    __handle_op(41);
-                    __handle_op(42);
-                    __handle_op(43);
-                    __handle_op(44);
-                    __handle_op(45);
-                    __handle_op(46);
-                    __handle_op(47);
-                    __handle_op(48);
-                    __handle_op(49);
-                    __handle_op(50);
-                    __handle_op(51);
-                    __handle_op(52);
-                    __handle_op(53);
-                    __handle_op(54);
-                    __handle_op(55);
-                    __handle_op(56);
-                    __handle_op(57);
-                    __handle_op(58);
-                    __handle_op(59);
-                    __handle_op(60);
-                    __handle_op(61);
-                    __handle_op(62);
-                    __handle_op(63);
-                default:
-                    break;
+                    clean = clean && instr.mConst[j] == old.mConst[j] && instr.mSrc[j] == old.mSrc[j];
+                    if (!clean)
+                        break;
+                    if (instr.mConst[j])
+                        clean = c.mConstants[instr.mSrc[j]] == parent.mCode.mConstants[instr.mSrc[j]];
+                    else if (instr.mSrc[j] >= codeStart)
+                        clean = cacheOffset[instr.mSrc[j] - codeStart] != NO_CACHE;
                 }
-#undef __handle_op
+                if (clean)
+                    cacheOffset[i] = parent.mOffset[i];
             }
         }
     };
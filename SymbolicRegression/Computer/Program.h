@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../Utils/Half.h"
+
+namespace SymbolicRegression::Computer
+{
+    template <typename T>
+    using Kernel = void (*)(const T *, const T *, T *__restrict) noexcept;
+
+    // widens a batch of a 16 bit dataset column
+    template <typename T>
+    using Widen = void (*)(const uint16_t *, T *__restrict) noexcept;
+
+    constexpr size_t NO_CACHE = std::numeric_limits<size_t>::max();
+
+    template <typename T>
+    struct Operand
+    {
+        const T *mPtr{nullptr};
+        size_t mStride{0};             // dataset columns advance by BATCH per batch index, memory and constants stay
+        size_t mCacheOffset{NO_CACHE}; // otherwise the value is read at this offset of the batch's cache entry
+    };
+
+    template <typename T>
+    struct Step
+    {
+        Kernel<T> mKernel{nullptr};
+        Operand<T> mSrc[2]{};
+        T *mDst{nullptr};
+        size_t mDstCacheOffset{NO_CACHE}; // set when the result is stored into the batch's cache entry
+    };
+
+    // 16 bit input column read by the program, widened into mDst at the start of each batch
+    template <typename T>
+    struct Load
+    {
+        const uint16_t *mSrc{nullptr};
+        T *mDst{nullptr};
+    };
+
+    // Straight-line form of Code<T> produced by Processor::Compile, live instructions only,
+    // operands resolved to pointers and constants copied, so a batch is just a run of kernel calls.
+    // Memory slots are reused once their value is dead, mSlotCount is the peak number in use.
+    template <typename T>
+    struct Program
+    {
+        constexpr static uint32_t NOT_LIVE = std::numeric_limits<uint32_t>::max();
+        constexpr static uint32_t NOT_FOLDED = std::numeric_limits<uint32_t>::max();
+        constexpr static uint32_t NO_LOAD = std::numeric_limits<uint32_t>::max();
+
+        void Clear() noexcept
+        {
+            mSteps.clear();
+            mConstants.clear();
+            mOutput = nullptr;
+            mSlotCount = 0;
+            mUsesCache = false;
+            mLoads.clear();
+            mWiden = nullptr;
+            mStorage = Utils::Storage::Full;
+        }
+
+        std::vector<Step<T>> mSteps{};
+        std::vector<T> mConstants{};
+        T *mOutput{nullptr};
+        uint32_t mSlotCount{0};
+        bool mUsesCache{false};
+        std::vector<Load<T>> mLoads{};    // inputs of a compact dataset, see Processor::Stage
+        Widen<T> mWiden{nullptr};
+        Utils::Storage mStorage{Utils::Storage::Full};
+        std::vector<T> mStaging{};        // widened input batches, steps point into it
+
+        // Compile scratch, kept to avoid reallocation
+        std::vector<uint32_t> mLastUse{}; // index of the last live reader, NOT_LIVE for dead instructions
+        std::vector<uint32_t> mSlot{};
+        std::vector<uint32_t> mFreeSlots{};
+        std::vector<size_t> mCacheOffset{}; // instructions taken unchanged from the cached parent
+        std::vector<uint32_t> mFolded{};    // index into mConstants of constant-only instructions, NOT_FOLDED otherwise
+        std::vector<uint32_t> mLoadOf{}; // index into mLoads of an input column, NO_LOAD otherwise
+    };
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Computer/Instructions/Prototype.h"
+#include "Utils/Cpu.h"
 
 namespace SymbolicRegression
 {
@@ -39,6 +40,14 @@ namespace SymbolicRegression
         double mClipMax;
         ConstSettings mInitConstSettings;
         CodeSettings mCodeSettings;
+        Utils::Isa mIsa{Utils::Isa::Auto}; // evaluation kernel variant, see Utils::SelectIsa
+        size_t mEvalCacheSize{0};          // bytes for cached intermediates of the hill climbers, 0 disables
+        bool mBatchNeighbours{false};      // evaluate the neighbours of a step together, batch by batch
+        uint64_t mRefineIterLimit{0};      // constants only steps of the float64 refinement of a mixed precision fit
+        uint32_t mMigrationInterval{0};    // steps between the code exchanges of the islands, 0 isolates them
+        uint32_t mMigrationTopology{0};    // islands an island imports from, see HillClimb::Topology
+        uint32_t mNeighbourThreads{1};     // threads evaluating the neighbours of a step and the initial and final population, more than one implies mBatchNeighbours
+        uint32_t mScoreThreads{1};         // threads a code scored on a large selection splits its batches over
     };
 
     struct FitParams
@@ -57,5 +66,6 @@ namespace SymbolicRegression
         std::vector<std::pair<Computer::Instructions::InstructionID, double>> mInstrProbs;
         std::vector<std::pair<uint32_t, double>> mFeatProbs;
         double mClassWeights[2];
+        bool mConstantsOnly{false}; // neighbours only mutate constants, see Solver::Refine
     };
 }
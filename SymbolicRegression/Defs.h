@@ -3,6 +3,7 @@
 inline constexpr double LARGE_FLOAT = 1.0e30;
 
 //#define LOG_ENABLED
+//#define STD_MATH
 
 #ifdef LOG_ENABLED
 #include "Utils/Log.h"
@@ -21,3 +22,23 @@ inline constexpr double LARGE_FLOAT = 1.0e30;
 #else
 #define ALWAYS_INLINE inline
 #endif
+
+// Evaluation kernels are built once per instruction set and picked at runtime (Utils/Cpu.h).
+// GCC/Clang compile each variant with a target attribute, flatten pulls the instruction and
+// metric loops into it. MSVC has no per-function target, all variants share the project /arch.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MULTI_ISA
+#define TARGET_SSE42 __attribute__((target("sse4.2,popcnt"), flatten))
+#define TARGET_AVX2 __attribute__((target("avx2,fma,bmi,bmi2,f16c"), flatten))
+#define TARGET_AVX512 __attribute__((target("avx2,fma,bmi,bmi2,f16c,avx512f,avx512dq,avx512vl,avx512bw"), flatten))
+#else
+#define TARGET_SSE42
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+// F16C half to float conversion for the avx2 and avx512 variants, DetectIsa checks for it with the rest of their features
+#if defined(MULTI_ISA) || defined(__AVX2__)
+#define HAS_F16C
+#include <immintrin.h>
+#endif
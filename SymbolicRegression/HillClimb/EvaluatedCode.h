@@ -17,6 +17,13 @@ namespace SymbolicRegression
         {
         }
 
+        template <typename U>
+        explicit EvaluatedCode(const EvaluatedCode<U> &other) noexcept
+            : mCode(other.mCode)
+        {
+            std::copy(std::begin(other.mScore), std::end(other.mScore), mScore);
+        }
+
         void ResetScore() noexcept
         {
             for (size_t i = 0; i < std::size(mScore); i++)
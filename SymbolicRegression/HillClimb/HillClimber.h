@@ -15,6 +15,11 @@ namespace SymbolicRegression::HillClimb
 		{
 		}
 
+		const auto &Current() const noexcept
+		{
+			return mCurrent;
+		}
+
 		auto &Current() noexcept
 		{
 			return mCurrent;
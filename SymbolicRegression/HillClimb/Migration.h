@@ -0,0 +1,55 @@
+#pragma once
+
+#include "SharedCode.h"
+
+namespace SymbolicRegression::HillClimb
+{
+    // islands an island imports from
+    enum class Topology : uint32_t
+    {
+        Ring = 0, // its predecessor
+        Full      // any other one, picked at random
+    };
+
+    // Codes the islands, solvers fitting in their own threads, publish for each other. Each island owns
+    // one SharedCode only it writes, readers never wait on a lock.
+    template <typename T>
+    class Migration
+    {
+    public:
+        Migration(size_t islands, const CodeSettings &cs, Topology topology) noexcept
+            : mTopology(topology)
+        {
+            for (size_t i = 0; i < islands; i++)
+            {
+                mSlots.push_back(std::make_unique<SharedCode<T>>(cs));
+            }
+        }
+
+        size_t Islands() const noexcept
+        {
+            return mSlots.size();
+        }
+
+        Topology GetTopology() const noexcept
+        {
+            return mTopology;
+        }
+
+        void Publish(size_t island, const EvaluatedCode<T> &evc) noexcept
+        {
+            mSlots[island]->Publish(evc);
+        }
+
+        // Copies the code last published by island into evc, false when there is none or it is the one
+        // of sequence, see SharedCode::Read
+        bool Read(size_t island, EvaluatedCode<T> &evc, uint64_t &sequence) const noexcept
+        {
+            return mSlots[island]->Read(evc, sequence);
+        }
+
+    private:
+        const Topology mTopology;
+        std::vector<std::unique_ptr<SharedCode<T>>> mSlots;
+    };
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "EvaluatedCode.h"
+
+namespace SymbolicRegression::HillClimb
+{
+    // An EvaluatedCode one thread publishes and any other one reads, guarded by a sequence counter that is
+    // odd while the code is written. Readers copy it and retry when the counter changed meanwhile, neither
+    // side ever waits on a lock, readers yield while a publish is under way. The code is kept as a flat array
+    // of atomic words, so the copy is race free whatever the readers see. Only one thread may publish at a time.
+    template <typename T>
+    class SharedCode
+    {
+        // opcode and const flags, sources, constants one per word, code size and the three scores
+        constexpr static size_t INSTRUCTION_WORDS = 2;
+        constexpr static size_t HEADER_WORDS = 4;
+
+    public:
+        explicit SharedCode(const CodeSettings &cs) noexcept
+            : mInstructionCount(cs.mMaxCodeSize),
+              mWords(std::make_unique<std::atomic<uint64_t>[]>(HEADER_WORDS + cs.mMaxCodeSize * INSTRUCTION_WORDS + cs.mConstSize))
+        {
+        }
+
+        void Publish(const EvaluatedCode<T> &evc) noexcept
+        {
+            const auto sequence = mSequence.load(std::memory_order_relaxed);
+            mSequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            const auto &code = evc.mCode;
+            auto *words = mWords.get();
+            words[0].store(code.mCodeSize, std::memory_order_relaxed);
+            for (size_t i = 0; i < 3; i++)
+            {
+                words[1 + i].store(std::bit_cast<uint64_t>(evc.mScore[i]), std::memory_order_relaxed);
+            }
+            words += HEADER_WORDS;
+            for (size_t i = 0; i < code.mCodeSize; i++)
+            {
+                const auto &instr = code.mCodeInstructions[i];
+                const auto op = static_cast<uint64_t>(instr.mOpCode) | (uint64_t)instr.mConst[0] << 32 | (uint64_t)instr.mConst[1] << 33;
+                words[i * INSTRUCTION_WORDS].store(op, std::memory_order_relaxed);
+                words[i * INSTRUCTION_WORDS + 1].store(instr.mSrc[0] | (uint64_t)instr.mSrc[1] << 32, std::memory_order_relaxed);
+            }
+            words += mInstructionCount * INSTRUCTION_WORDS;
+            for (size_t i = 0; i < code.mConstants.size(); i++)
+            {
+                words[i].store(ToWord(code.mConstants[i]), std::memory_order_relaxed);
+            }
+
+            mSequence.store(sequence + 2, std::memory_order_release);
+        }
+
+        // Copies the last published code into evc, of the same code settings, false when there is none or
+        // it is the one of sequence, which is then updated. The used instructions of evc are left to
+        // IsConstExpression.
+        bool Read(EvaluatedCode<T> &evc, uint64_t &sequence) const noexcept
+        {
+            auto &code = evc.mCode;
+            while (true)
+            {
+                const auto before = mSequence.load(std::memory_order_acquire);
+                if (before == 0 || before == sequence)
+                    return false;
+                if (before & 1)
+                {
+                    // the writer may share the core, let it finish
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                const auto *words = mWords.get();
+                code.mCodeSize = static_cast<uint32_t>(std::min<uint64_t>(words[0].load(std::memory_order_relaxed), code.mCodeInstructions.size()));
+                for (size_t i = 0; i < 3; i++)
+                {
+                    evc.mScore[i] = std::bit_cast<double>(words[1 + i].load(std::memory_order_relaxed));
+                }
+                words += HEADER_WORDS;
+                for (size_t i = 0; i < code.mCodeSize; i++)
+                {
+                    auto &instr = code.mCodeInstructions[i];
+                    const auto op = words[i * INSTRUCTION_WORDS].load(std::memory_order_relaxed);
+                    const auto src = words[i * INSTRUCTION_WORDS + 1].load(std::memory_order_relaxed);
+                    instr.mOpCode = static_cast<Computer::Instructions::InstructionID>(static_cast<uint32_t>(op));
+                    instr.mConst[0] = (op >> 32) & 1;
+                    instr.mConst[1] = (op >> 33) & 1;
+                    instr.mSrc[0] = static_cast<uint32_t>(src);
+                    instr.mSrc[1] = static_cast<uint32_t>(src >> 32);
+                }
+                words += mInstructionCount * INSTRUCTION_WORDS;
+                for (size_t i = 0; i < code.mConstants.size(); i++)
+                {
+                    code.mConstants[i] = FromWord(words[i].load(std::memory_order_relaxed));
+                }
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (mSequence.load(std::memory_order_relaxed) == before)
+                {
+                    sequence = before;
+                    return true;
+                }
+            }
+        }
+
+        bool Empty() const noexcept
+        {
+            return mSequence.load(std::memory_order_acquire) == 0;
+        }
+
+        // scores of the published code, LARGE_FLOAT before the first one
+        std::array<double, 3> Scores() const noexcept
+        {
+            std::array<double, 3> scores{LARGE_FLOAT, LARGE_FLOAT, LARGE_FLOAT};
+            while (true)
+            {
+                const auto before = mSequence.load(std::memory_order_acquire);
+                if (before == 0)
+                    return scores;
+                if (before & 1)
+                {
+                    // the writer may share the core, let it finish
+                    std::this_thread::yield();
+                    continue;
+                }
+                for (size_t i = 0; i < 3; i++)
+                {
+                    scores[i] = std::bit_cast<double>(mWords[1 + i].load(std::memory_order_relaxed));
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (mSequence.load(std::memory_order_relaxed) == before)
+                    return scores;
+            }
+        }
+
+    private:
+        static uint64_t ToWord(T value) noexcept
+        {
+            if constexpr (sizeof(T) == sizeof(uint32_t))
+                return std::bit_cast<uint32_t>(value);
+            else
+                return std::bit_cast<uint64_t>(value);
+        }
+
+        static T FromWord(uint64_t word) noexcept
+        {
+            if constexpr (sizeof(T) == sizeof(uint32_t))
+                return std::bit_cast<T>(static_cast<uint32_t>(word));
+            else
+                return std::bit_cast<T>(word);
+        }
+
+        const size_t mInstructionCount;
+        alignas(64) std::atomic<uint64_t> mSequence{0};
+        std::unique_ptr<std::atomic<uint64_t>[]> mWords;
+    };
+}
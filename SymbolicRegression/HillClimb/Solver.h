@@ -3,6 +3,7 @@
 #include "Mutation.h"
 #include "HillClimber.h"
 #include "CodeInitializer.h"
+#include "Migration.h"
 #include "../Utils/Dataset.h"
 #include "../Computer/Machine.h"
 
@@ -18,6 +19,20 @@ namespace SymbolicRegression::HillClimb
         std::vector<double> mConstants;
     };
 
+    // Progress of a running fit, written by its solver only and readable from any thread
+    struct FitProgress
+    {
+        std::atomic<uint64_t> mIterations{0};
+        // best sample score of the population, the score on all data of the best code once the fit ends
+        std::atomic<double> mScore{LARGE_FLOAT};
+
+        void Reset() noexcept
+        {
+            mIterations.store(0, std::memory_order_relaxed);
+            mScore.store(LARGE_FLOAT, std::memory_order_relaxed);
+        }
+    };
+
     template <typename T, size_t BATCH, bool DBG = false>
     class Solver
     {
@@ -36,11 +51,26 @@ namespace SymbolicRegression::HillClimb
             : mInitialized(false),
               mConfig(config),
               mRandom(),
-              mMachine(config.mCodeSettings),
+              mMachine(config.mCodeSettings, Utils::SelectIsa(config.mIsa), config.mPopulationSize, config.mEvalCacheSize),
               mPopulation(config.mPopulationSize, config.mCodeSettings),
-              mBestCode(config.mCodeSettings)
+              mBestCode(config.mCodeSettings),
+              mImmigrant(config.mCodeSettings),
+              mPublishedBest(config.mCodeSettings),
+              mPredictMachine(config.mCodeSettings, Utils::SelectIsa(config.mIsa)),
+              mPredictCode(config.mCodeSettings)
         {
             mRandom.Seed(config.mRandomSeed);
+            for (size_t i = 0; i < mPopulation.size(); i++)
+            {
+                mPublished.push_back(std::make_unique<SharedCode<T>>(config.mCodeSettings));
+            }
+            // the neighbours are split over the threads once they are all generated
+            mConfig.mBatchNeighbours |= mConfig.mNeighbourThreads > 1;
+            for (size_t i = 1; i < mConfig.mNeighbourThreads; i++)
+            {
+                mWorkers.push_back(std::make_unique<Machine>(config.mCodeSettings, Utils::SelectIsa(config.mIsa), config.mPopulationSize, config.mEvalCacheSize));
+            }
+            mParts.resize(mConfig.mNeighbourThreads);
         }
 
         template <typename CALLBACK>
@@ -61,6 +91,15 @@ namespace SymbolicRegression::HillClimb
 
             if (fp.mVerbose > 1)
                 callback(0, mBestCode.mScore[2]);
+            for (const auto &hc : mPopulation)
+            {
+                ReportScore(hc.Best().mScore[1]);
+            }
+
+            for (size_t i = 0; i < mParts.size(); i++)
+            {
+                GetMachine(i).ResetCache(data);
+            }
 
             const CodeMutation codeMut{fp.mBeta, fp.mConstSettings, fp.mInstrProbs, fp.mFeatProbs, mRandom};
             const ConstMutation<T> constMut{mRandom, fp.mConstSettings};
@@ -69,10 +108,16 @@ namespace SymbolicRegression::HillClimb
             indices.reserve((size_t)mConfig.mCodeSettings.mMaxCodeSize * 2);
 
             EvCode neighbour(mConfig.mCodeSettings);
+            if (mConfig.mBatchNeighbours)
+            {
+                mCandidates.resize(fp.mNeighboursCount, neighbour);
+                mCandidateResults.resize(fp.mNeighboursCount);
+            }
             std::vector<size_t> sel0(fp.mPretestSize);
 
             Utils::Result<BATCH> r;
             std::vector<Utils::BatchScore> worstBatches;
+            std::vector<Utils::BatchScore> sampleOrder;
 
             size_t it{};
             while (true)
@@ -84,6 +129,14 @@ namespace SymbolicRegression::HillClimb
                         printf("iter limit reached! it: %zu\n", it - 1);
                     break;
                 }
+                if (mCancel && mCancel->load(std::memory_order_relaxed))
+                {
+                    if (fp.mVerbose > 1)
+                        printf("fit cancelled! it: %zu\n", it - 1);
+                    break;
+                }
+                if (mProgress)
+                    mProgress->mIterations.fetch_add(1, std::memory_order_relaxed);
                 if (fp.mTimeLimit && it % 100 == 0)
                 {
                     const auto duration = (uint64_t)duration_cast<milliseconds>(high_resolution_clock::now() - fitStartTime).count();
@@ -104,10 +157,20 @@ namespace SymbolicRegression::HillClimb
                     }
                 }
 
+                if (mMigration && it % mConfig.mMigrationInterval == 0)
+                {
+                    Migrate(data, fp, sampleWeight);
+                }
+
                 const auto [hillclimber, selIdx] = TournamentSelection(fp.mTournament);
 
                 auto bestCode = hillclimber->Current();
                 auto bestScore = LARGE_FLOAT;
+                // neighbours only recompute what changed against the current code
+                for (size_t i = 0; i < mParts.size(); i++)
+                {
+                    GetMachine(i).SetParent(data, selIdx, hillclimber->Current().mCode);
+                }
                 bool find = false;
 
                 for (size_t i = 0; i < hillclimber->mPretest.size(); i++)
@@ -115,107 +178,331 @@ namespace SymbolicRegression::HillClimb
                     sel0[i] = hillclimber->mPretest[i].mIndex;
                 }
 
-                for (uint32_t subStep = 0; subStep < fp.mNeighboursCount; subStep++)
-                {
-                    neighbour = hillclimber->Current();
-                    neighbour.ResetScore();
+                // neighbours scoring at least these are rejected, so their evaluation stops once that is certain
+                const auto pretestBound = (1.0 + fp.mAlpha) * hillclimber->Current().mScore[0];
+                const auto acceptBound = hillclimber->Best().mScore[1] * (1.0 + fp.mAlpha);
 
-                    for (int muteStep = 0; muteStep < 1; muteStep++)
+                if (mConfig.mBatchNeighbours)
+                {
+                    // same neighbours and choice as below, generated first and evaluated together
+                    size_t count = 0;
+                    for (uint32_t subStep = 0; subStep < fp.mNeighboursCount; subStep++)
                     {
-                        codeMut(neighbour.mCode);
-                        constMut(neighbour.mCode);
-
-                        if (neighbour.mCode.IsConstExpression(indices.data(), mCodeMapping.set))
+                        auto &candidate = mCandidates[count];
+                        candidate = hillclimber->Current();
+                        candidate.ResetScore();
+                        if (!fp.mConstantsOnly)
+                            codeMut(candidate.mCode);
+                        constMut(candidate.mCode);
+
+                        if (candidate.mCode.IsConstExpression(indices.data(), mCodeMapping.set))
                             continue;
 
-                        Evaluate(data, neighbour, sel0, 0, fp, sampleWeight, r);
+                        count++;
+                    }
 
-                        if (neighbour.mScore[0] >= (1.0 + fp.mAlpha) * hillclimber->Current().mScore[0])
-                        {
+                    EvaluateNeighbours(data, count, sel0, 0, fp, sampleWeight, pretestBound);
+
+                    // the ones passing the pretest, in order
+                    size_t passed = 0;
+                    for (size_t k = 0; k < count; k++)
+                    {
+                        if (mCandidates[k].mScore[0] >= pretestBound)
                             continue;
-                        }
+                        std::swap(mCandidates[passed], mCandidates[k]);
+                        passed++;
+                    }
 
-                        Evaluate(data, neighbour, hillclimber->mSample, 1, fp, sampleWeight, r);
+                    EvaluateNeighbours(data, passed, hillclimber->mSample, 1, fp, sampleWeight, acceptBound);
 
-                        if (neighbour.mScore[1] < bestScore)
+                    for (size_t k = 0; k < passed; k++)
+                    {
+                        if (mCandidates[k].mScore[1] < bestScore)
                         {
-                            bestCode = neighbour;
-                            bestScore = neighbour.mScore[1];
-                            r.GetNWorst(fp.mPretestSize, worstBatches);
+                            bestCode = mCandidates[k];
+                            bestScore = mCandidates[k].mScore[1];
+                            mCandidateResults[k].GetNWorst(fp.mPretestSize, worstBatches);
+                            mCandidateResults[k].GetNWorst(hillclimber->mSample.size(), sampleOrder);
                             find = true;
                         }
                     }
                 }
+                else
+                {
+                    for (uint32_t subStep = 0; subStep < fp.mNeighboursCount; subStep++)
+                    {
+                        neighbour = hillclimber->Current();
+                        neighbour.ResetScore();
+
+                        for (int muteStep = 0; muteStep < 1; muteStep++)
+                        {
+                            if (!fp.mConstantsOnly)
+                                codeMut(neighbour.mCode);
+                            constMut(neighbour.mCode);
+
+                            if (neighbour.mCode.IsConstExpression(indices.data(), mCodeMapping.set))
+                                continue;
+
+                            Evaluate(data, neighbour, sel0, 0, fp, sampleWeight, r, true, pretestBound);
+
+                            if (neighbour.mScore[0] >= pretestBound)
+                            {
+                                continue;
+                            }
+
+                            Evaluate(data, neighbour, hillclimber->mSample, 1, fp, sampleWeight, r, true, std::min(bestScore, acceptBound));
+
+                            if (neighbour.mScore[1] < bestScore)
+                            {
+                                bestCode = neighbour;
+                                bestScore = neighbour.mScore[1];
+                                r.GetNWorst(fp.mPretestSize, worstBatches);
+                                r.GetNWorst(hillclimber->mSample.size(), sampleOrder);
+                                find = true;
+                            }
+                        }
+                    }
+                }
 
                 if (find)
                 {
-                    if (bestCode.mScore[1] < hillclimber->Best().mScore[1] * (1.0 + fp.mAlpha))
+                    if (bestCode.mScore[1] < acceptBound)
                     {
                         hillclimber->Current() = bestCode;
+                        SetSampleOrder(*hillclimber, sampleOrder);
                         if (bestCode.mScore[1] < hillclimber->Best().mScore[1])
                         {
                             bestCode.mScore[0] = GetScore(worstBatches);
                             hillclimber->Best() = bestCode;
                             hillclimber->mPretest = worstBatches;
+                            PublishClimber(selIdx);
+                            PublishInterim(bestCode);
                         }
                     }
                 }
             }
-            return EvalPopulation(data, fp, sampleWeight);
+            const auto score = EvalPopulation(data, fp, sampleWeight);
+            if (mProgress)
+                mProgress->mScore.store(score, std::memory_order_relaxed);
+            return score;
         }
 
-        void Predict(Dataset &data, uint32_t transformation, T clipMin, T clipMax) noexcept
+        // Takes over the population of a solver that searched in another precision, rescores it in T,
+        // re-tunes its constants for mConfig.mRefineIterLimit steps and rescores the best on all data.
+        // The samples and pretests are kept, data must have the same batches as the searched one.
+        template <typename U, typename CALLBACK>
+        double Refine(const Dataset &data,
+                      const FitParams &fp,
+                      CALLBACK &&callback,
+                      const std::vector<HillClimber<U>> &population,
+                      const Utils::BatchVector<T, BATCH> *sampleWeight)
         {
-            mMachine.Compute(data, mBestCode.mCode, transformation, clipMin, clipMax);
+            assert(population.size() == mPopulation.size());
+
+            mFullSet.resize(data.BatchCount());
+            std::iota(mFullSet.begin(), mFullSet.end(), 0);
+
+            Utils::Result<BATCH> r;
+            std::vector<size_t> pretest;
+            std::vector<Utils::BatchScore> sampleOrder;
+            mBestCode.ResetScore();
+            for (size_t i = 0; i < mPopulation.size(); i++)
+            {
+                auto &hc = mPopulation[i];
+                const auto &src = population[i];
+                hc.mSample = src.mSample;
+
+                hc.Best() = EvCode{src.Best()};
+                hc.Best().mScore[2] = LARGE_FLOAT;
+                Evaluate(data, hc.Best(), hc.mSample, 1, fp, sampleWeight, r);
+                r.GetNWorst(src.mPretest.size(), hc.mPretest);
+                hc.Best().mScore[0] = GetScore(hc.mPretest);
+
+                pretest.resize(hc.mPretest.size());
+                for (size_t k = 0; k < pretest.size(); k++)
+                {
+                    pretest[k] = hc.mPretest[k].mIndex;
+                }
+                hc.Current() = EvCode{src.Current()};
+                hc.Current().mScore[2] = LARGE_FLOAT;
+                Evaluate(data, hc.Current(), pretest, 0, fp, sampleWeight, r);
+                Evaluate(data, hc.Current(), hc.mSample, 1, fp, sampleWeight, r);
+                r.GetNWorst(hc.mSample.size(), sampleOrder);
+                SetSampleOrder(hc, sampleOrder);
+
+                if (hc.Best().mScore[1] < mBestCode.mScore[1])
+                {
+                    mBestCode = hc.Best();
+                }
+                PublishClimber(i);
+            }
+            PublishBest();
+            mInitialized = true;
+
+            if (!mConfig.mRefineIterLimit)
+                return EvalPopulation(data, fp, sampleWeight);
+
+            auto refine = fp;
+            refine.mTimeLimit = 0;
+            refine.mIterLimit = mConfig.mRefineIterLimit;
+            refine.mConstantsOnly = true;
+            return Fit(data, refine, callback, sampleWeight);
+        }
+
+        const auto &GetPopulation() const noexcept
+        {
+            return mPopulation;
+        }
+
+        // threads of the parallel work of the solver, it is shared with the other solvers of a handle
+        void SetThreadPool(Utils::ThreadPool *pool) noexcept
+        {
+            mPool = pool;
+            for (size_t i = 0; i < mParts.size(); i++)
+            {
+                GetMachine(i).SetThreadPool(pool);
+            }
+            mPredictMachine.SetThreadPool(pool);
+        }
+
+        // fits report their progress to progress and stop at their next step once cancel is set, either may be nullptr
+        void SetProgress(FitProgress *progress, const std::atomic<bool> *cancel) noexcept
+        {
+            mProgress = progress;
+            mCancel = cancel;
         }
 
-        void Predict(Dataset &data, uint32_t transformation, uint32_t id, T clipMin, T clipMax) noexcept
+        // the solver becomes island of migration, the islands fit concurrently and exchange their best codes
+        // every mConfig.mMigrationInterval steps, nullptr or a zero interval isolates it
+        void SetMigration(Migration<T> *migration, size_t island) noexcept
         {
-            auto &hc = mPopulation[id];
-            mMachine.Compute(data, hc.Best().mCode, transformation, clipMin, clipMax);
+            mMigration = mConfig.mMigrationInterval && migration && migration->Islands() > 1 ? migration : nullptr;
+            mIsland = island;
+            mImported.assign(migration ? migration->Islands() : 0, 0);
         }
 
-        const auto &GetBestCode()
+        // The models are read from their published snapshots, see PublishClimber and PublishInterim, so
+        // the functions below can run in another thread while the solver fits. One thread at a time may
+        // call them.
+
+        // predicts the first batchCount batches of data with the best code, split over threads
+        void Predict(Dataset &data, uint32_t transformation, T clipMin, T clipMax, size_t batchCount, size_t threads = 1) noexcept
+        {
+            mPublishedBest.Read(mPredictCode, mPredictSequence);
+            Predict(data, mPredictCode.mCode, transformation, clipMin, clipMax, batchCount, threads);
+        }
+
+        void Predict(Dataset &data, uint32_t transformation, uint32_t id, T clipMin, T clipMax, size_t batchCount, size_t threads = 1) noexcept
+        {
+            ReadModel(id, mPredictCode);
+            mPredictSequence = 0;
+            Predict(data, mPredictCode.mCode, transformation, clipMin, clipMax, batchCount, threads);
+        }
+
+        // on a machine of its own, apart from the one of the fit
+        void Predict(Dataset &data, const Code &code, uint32_t transformation, T clipMin, T clipMax, size_t batchCount, size_t threads = 1) noexcept
+        {
+            mPredictMachine.Compute(data, code, transformation, clipMin, clipMax, batchCount, threads);
+        }
+
+        // false before the first fit publishes its models, the codes read until then are empty
+        bool Published() const noexcept
+        {
+            return !mPublishedBest.Empty();
+        }
+
+        // the best code, or the best one on its sample found by the running fit, false before the first fit
+        bool ReadBest(EvCode &evc) const noexcept
+        {
+            uint64_t sequence = 0;
+            return mPublishedBest.Read(evc, sequence);
+        }
+
+        // the best code of the climber idx, false before the first fit
+        bool ReadModel(size_t idx, EvCode &evc) const noexcept
+        {
+            uint64_t sequence = 0;
+            return mPublished[idx]->Read(evc, sequence);
+        }
+
+        // score on all data and on the sample of a population model, the former is LARGE_FLOAT until it is rescored
+        std::pair<double, double> GetScores(size_t idx) const noexcept
+        {
+            const auto scores = mPublished[idx]->Scores();
+            return {scores[2], scores[1]};
+        }
+
+        // GetScores of the best code
+        std::pair<double, double> GetBestScores() const noexcept
         {
-            return mBestCode;
+            const auto scores = mPublishedBest.Scores();
+            return {scores[2], scores[1]};
         }
 
+        // The climbers are rescored in waves of one per neighbour thread, each on its own machine, a wave takes
+        // the next climbers qualifying by the best score so far. Their scores are then taken in turn like the
+        // climbers were rescored one after another, the ones the wave's earlier scores disqualify are dropped.
         double EvalPopulation(const Dataset &data,
                               const FitParams &fp,
                               const Utils::BatchVector<T, BATCH> *sampleWeight,
                               double alpha = 0.05) noexcept
         {
             auto bestScore = mBestCode.mScore[2];
-            Utils::Result<BATCH> r;
-            for (auto &hc : mPopulation)
+            const auto threads = mPool ? mParts.size() : 1;
+            mFullScores.resize(threads);
+            for (size_t next = 0; next < mPopulation.size();)
             {
-                if (hc.Best().mScore[1] > (1.0 + alpha) * bestScore)
-                    continue;
-                hc.Best().mScore[2] = EvaluateAll(data, hc.Best(), fp, sampleWeight, r);
-                if (hc.Best().mScore[2] < bestScore)
+                mWave.clear();
+                for (; next < mPopulation.size() && mWave.size() < threads; next++)
                 {
-                    bestScore = hc.Best().mScore[2];
-                    mBestCode = hc.Best();
+                    if (mPopulation[next].Best().mScore[1] <= (1.0 + alpha) * bestScore)
+                        mWave.push_back(next);
+                }
+                if (mWave.empty())
+                    break;
+
+                ParallelFor(mWave.size(), [&](size_t p) noexcept
+                            { mFullScores[p] = EvaluateAll(GetMachine(p), data, mPopulation[mWave[p]].Best(), fp, sampleWeight, mParts[p].mResult); });
+                for (size_t p = 0; p < mWave.size(); p++)
+                {
+                    auto &hc = mPopulation[mWave[p]];
+                    if (hc.Best().mScore[1] > (1.0 + alpha) * bestScore)
+                        continue;
+                    hc.Best().mScore[2] = mFullScores[p];
+                    PublishClimber(mWave[p]);
+                    if (hc.Best().mScore[2] < bestScore)
+                    {
+                        bestScore = hc.Best().mScore[2];
+                        mBestCode = hc.Best();
+                    }
                 }
             }
+            PublishBest();
             return mBestCode.mScore[2];
         }
 
         double Score() const noexcept
         {
-            return mBestCode.mScore[2];
+            return mPublishedBest.Scores()[2];
         }
 
         CodeInfo GetBestInfo() noexcept
         {
-            return CodeInfo{mBestCode.mScore[2], mBestCode.mScore[1], GetExpression(mBestCode), GenerateCode(mBestCode, "equation"), mBestCode.mCode.GetConstants()};
+            EvCode code{mConfig.mCodeSettings};
+            ReadBest(code);
+            return GetInfo(code, "equation");
         }
 
         CodeInfo GetInfo(size_t threadIdx, size_t idx) noexcept
         {
-            auto &code = mPopulation[idx].Best();
-            const std::string eq_name = "equation_" + std::to_string(threadIdx) + "_" + std::to_string(idx);
-            return CodeInfo{code.mScore[2], code.mScore[1], GetExpression(code), GenerateCode(code, eq_name), code.mCode.GetConstants()};
+            EvCode code{mConfig.mCodeSettings};
+            ReadModel(idx, code);
+            return GetInfo(code, "equation_" + std::to_string(threadIdx) + "_" + std::to_string(idx));
+        }
+
+        CodeInfo GetInfo(EvCode &code, const std::string &eqName) noexcept
+        {
+            return CodeInfo{code.mScore[2], code.mScore[1], GetExpression(code), GenerateCode(code, eqName), code.mCode.GetConstants()};
         }
 
         std::string GetExpression(EvCode &c) noexcept
@@ -281,72 +568,293 @@ namespace SymbolicRegression::HillClimb
             std::vector<size_t>
                 pretest(pretestSize);
             selectSample(pretestSize, pretest);
-            Utils::Result<BATCH> r;
+
+            // The candidates of a climber are generated a round of one per neighbour thread ahead and scored
+            // together. The choice then goes through them in order and the random engine is set back to its
+            // state after the last one the sequential search would have generated, so the population and the
+            // following draws are the same whatever the thread count.
+            const auto threads = mPool ? mParts.size() : 1;
+            std::vector<EvCode> candidates(threads, EvCode{mConfig.mCodeSettings});
+            std::vector<uint8_t> constant(threads);
+            std::vector<Utils::RandomEngine> states(threads);
 
             for (auto &hc : mPopulation)
             {
                 selectSample(sampleSize, hc.mSample);
-                EvCode candidate{mConfig.mCodeSettings};
 
                 int cnt = 3;
                 int k = 30;
                 auto bestScore = LARGE_FLOAT;
                 while (cnt && k)
                 {
-                    codeInit.operator()(candidate.mCode);
-
-                    if (!candidate.mCode.IsConstExpression(indices.data(), mCodeMapping.set))
+                    const auto round = std::min<size_t>(threads, k);
+                    for (size_t j = 0; j < round; j++)
                     {
-                        Evaluate(data, candidate, pretest, 0, fp, sampleWeight, r);
+                        codeInit.operator()(candidates[j].mCode);
+                        constant[j] = candidates[j].mCode.IsConstExpression(indices.data(), mCodeMapping.set);
+                        states[j] = mRandom;
+                    }
+                    ParallelFor(round, [&](size_t j) noexcept
+                                {
+                        if (!constant[j])
+                            Evaluate(GetMachine(j), data, candidates[j], pretest, 0, fp, sampleWeight, mParts[j].mResult); });
 
-                        if (cnt == 3 || candidate.mScore[0] < bestScore)
+                    for (size_t j = 0; j < round && cnt && k; j++)
+                    {
+                        if (!constant[j] && (cnt == 3 || candidates[j].mScore[0] < bestScore))
                         {
-                            bestScore = candidate.mScore[0];
-                            hc.Current() = candidate;
+                            bestScore = candidates[j].mScore[0];
+                            hc.Current() = candidates[j];
                             cnt--;
                         }
+                        k--;
+                        mRandom = states[j];
                     }
-                    k--;
                 }
+            }
+
+            // the chosen codes are scored on their samples climber by climber in parallel
+            ParallelForClimbers([&](size_t p, size_t i) noexcept
+                                {
+                auto &hc = mPopulation[i];
+                auto &part = mParts[p];
                 auto &current = hc.Current();
-                Evaluate(data, current, hc.mSample, 1, fp, sampleWeight, r);
-                r.GetNWorst(pretestSize, hc.mPretest);
+                Evaluate(GetMachine(p), data, current, hc.mSample, 1, fp, sampleWeight, part.mResult);
+                part.mResult.GetNWorst(pretestSize, hc.mPretest);
+                part.mResult.GetNWorst(hc.mSample.size(), part.mSampleOrder);
+                SetSampleOrder(hc, part.mSampleOrder);
                 current.mScore[0] = GetScore(hc.mPretest);
                 hc.Best() = hc.Current();
+                PublishClimber(i); });
 
+            for (const auto &hc : mPopulation)
+            {
                 if (hc.Best().mScore[1] < mBestCode.mScore[1])
                 {
                     mBestCode = hc.Current();
                 }
             }
+            PublishBest();
 
             mInitialized = true;
         }
 
-        void Evaluate(const Dataset &data,
+        bool Evaluate(const Dataset &data,
+                      EvCode &evc,
+                      const std::vector<size_t> &batchSelection,
+                      int id,
+                      const FitParams &fp,
+                      const Utils::BatchVector<T, BATCH> *sampleWeight,
+                      Utils::Result<BATCH> &r,
+                      bool incremental = false,
+                      double bound = Machine::NO_BOUND) noexcept
+        {
+            return Evaluate(mMachine, data, evc, batchSelection, id, fp, sampleWeight, r, incremental, bound);
+        }
+
+        bool Evaluate(Machine &machine,
+                      const Dataset &data,
                       EvCode &evc,
                       const std::vector<size_t> &batchSelection,
                       int id,
                       const FitParams &fp,
                       const Utils::BatchVector<T, BATCH> *sampleWeight,
-                      Utils::Result<BATCH> &r) noexcept
+                      Utils::Result<BATCH> &r,
+                      bool incremental = false,
+                      double bound = Machine::NO_BOUND) noexcept
         {
             r.Reset();
-            mMachine.ComputeScore(data, evc.mCode, batchSelection, r, mConfig.mTransformation, fp.mMetric, (T)mConfig.mClipMin, (T)mConfig.mClipMax, (T)fp.mClassWeights[0], (T)fp.mClassWeights[1], true, sampleWeight);
-            evc.mScore[id] = r.Mean();
+            const auto complete = machine.ComputeScore(data, evc.mCode, batchSelection, r, mConfig.mTransformation, fp.mMetric, (T)mConfig.mClipMin, (T)mConfig.mClipMax, (T)fp.mClassWeights[0], (T)fp.mClassWeights[1], sampleWeight, incremental, bound, false, mConfig.mScoreThreads);
+            evc.mScore[id] = complete ? r.Mean() : PartialScore(r, batchSelection);
+            return complete;
+        }
+
+        // lower bound of the score of an abandoned code, at least the bound it was abandoned at
+        static double PartialScore(const Utils::Result<BATCH> &r, const std::vector<size_t> &batchSelection) noexcept
+        {
+            return r.mScoreSum / (batchSelection.size() * BATCH);
+        }
+
+        // Evaluate of the first count candidates together by Machine::ComputeScores, their batch results are left
+        // in mCandidateResults
+        void EvaluateNeighbours(const Dataset &data,
+                                size_t count,
+                                const std::vector<size_t> &batchSelection,
+                                int id,
+                                const FitParams &fp,
+                                const Utils::BatchVector<T, BATCH> *sampleWeight,
+                                double bound) noexcept
+        {
+            mPendingCodes.clear();
+            mPendingResults.clear();
+            for (size_t k = 0; k < count; k++)
+            {
+                auto &r = mCandidateResults[k];
+                r.Reset();
+                mPendingCodes.push_back(&mCandidates[k].mCode);
+                mPendingResults.push_back(&r);
+            }
+            if (count == 0)
+                return;
+
+            const auto compute = [&](Machine &machine, const auto &codes, const auto &results, auto &complete) noexcept
+            {
+                machine.ComputeScores(data, codes, batchSelection, results, mConfig.mTransformation, fp.mMetric, (T)mConfig.mClipMin, (T)mConfig.mClipMax, (T)fp.mClassWeights[0], (T)fp.mClassWeights[1], sampleWeight, complete, true, bound);
+            };
+            const auto parts = mPool ? std::min(mParts.size(), count) : 1;
+            if (parts == 1)
+            {
+                compute(mMachine, mPendingCodes, mPendingResults, mComplete);
+            }
+            else
+            {
+                // each thread scores a contiguous range of the pending codes on its own machine, the bound is
+                // fixed for the step, so every code gets the same result whichever thread scores it
+                mPool->ParallelFor(parts, [&](size_t p) noexcept
+                                   {
+                    auto &part = mParts[p];
+                    const auto first = count * p / parts;
+                    const auto last = count * (p + 1) / parts;
+                    part.mCodes.assign(mPendingCodes.begin() + first, mPendingCodes.begin() + last);
+                    part.mResults.assign(mPendingResults.begin() + first, mPendingResults.begin() + last);
+                    compute(GetMachine(p), part.mCodes, part.mResults, part.mComplete); });
+                mComplete.clear();
+                for (size_t p = 0; p < parts; p++)
+                {
+                    mComplete.insert(mComplete.end(), mParts[p].mComplete.begin(), mParts[p].mComplete.end());
+                }
+            }
+            for (size_t k = 0; k < count; k++)
+            {
+                const auto &r = mCandidateResults[k];
+                mCandidates[k].mScore[id] = mComplete[k] ? r.Mean() : PartialScore(r, batchSelection);
+            }
         }
 
-        auto EvaluateAll(const Dataset &data,
+        auto EvaluateAll(Machine &machine,
+                         const Dataset &data,
                          const EvCode &evc,
                          const FitParams &fp,
                          const Utils::BatchVector<T, BATCH> *sampleWeight,
                          Utils::Result<BATCH> &r) noexcept
         {
             r.Reset();
-            mMachine.ComputeScore(data, evc.mCode, mFullSet, r, mConfig.mTransformation, fp.mMetric, (T)mConfig.mClipMin, (T)mConfig.mClipMax, (T)fp.mClassWeights[0], (T)fp.mClassWeights[1], true, sampleWeight);
+            machine.ComputeScore(data, evc.mCode, mFullSet, r, mConfig.mTransformation, fp.mMetric, (T)mConfig.mClipMin, (T)mConfig.mClipMax, (T)fp.mClassWeights[0], (T)fp.mClassWeights[1], sampleWeight, false, Machine::NO_BOUND, true, mConfig.mScoreThreads);
             return r.Mean();
         }
 
+        // Publishes the best code of the population by sample score and imports the code another island
+        // published last, unless it was imported already. The immigrant replaces the best code of the worst
+        // hill climber when it scores better on its sample, the climber then continues from it.
+        void Migrate(const Dataset &data, const FitParams &fp, const Utils::BatchVector<T, BATCH> *sampleWeight) noexcept
+        {
+            auto best = mPopulation.begin();
+            auto worst = mPopulation.begin();
+            for (auto hc = mPopulation.begin(); hc != mPopulation.end(); ++hc)
+            {
+                if (hc->Best().mScore[1] < best->Best().mScore[1])
+                    best = hc;
+                if (hc->Best().mScore[1] > worst->Best().mScore[1])
+                    worst = hc;
+            }
+            mMigration->Publish(mIsland, best->Best());
+
+            const auto islands = mMigration->Islands();
+            auto source = (mIsland + islands - 1) % islands;
+            if (mMigration->GetTopology() == Topology::Full)
+            {
+                source = mRandom.Rand(islands - 1);
+                source += source >= mIsland;
+            }
+            if (!mMigration->Read(source, mImmigrant, mImported[source]))
+                return;
+
+            std::vector<uint32_t> indices;
+            indices.reserve((size_t)mConfig.mCodeSettings.mMaxCodeSize * 2);
+            if (mImmigrant.mCode.IsConstExpression(indices.data(), mCodeMapping.set))
+                return;
+
+            Utils::Result<BATCH> r;
+            Evaluate(data, mImmigrant, worst->mSample, 1, fp, sampleWeight, r);
+            if (mImmigrant.mScore[1] >= worst->Best().mScore[1])
+                return;
+
+            std::vector<Utils::BatchScore> sampleOrder;
+            r.GetNWorst(worst->mPretest.size(), worst->mPretest);
+            r.GetNWorst(worst->mSample.size(), sampleOrder);
+            mImmigrant.mScore[0] = GetScore(worst->mPretest);
+            mImmigrant.mScore[2] = LARGE_FLOAT;
+            worst->Best() = mImmigrant;
+            worst->Current() = mImmigrant;
+            SetSampleOrder(*worst, sampleOrder);
+            PublishClimber(worst - mPopulation.begin());
+            PublishInterim(mImmigrant);
+        }
+
+        void ReportScore(double score) noexcept
+        {
+            if (mProgress && score < mProgress->mScore.load(std::memory_order_relaxed))
+                mProgress->mScore.store(score, std::memory_order_relaxed);
+        }
+
+        // the best code of climber i for ReadModel, see SharedCode
+        void PublishClimber(size_t i) noexcept
+        {
+            mPublished[i]->Publish(mPopulation[i].Best());
+        }
+
+        // mBestCode for ReadBest
+        void PublishBest() noexcept
+        {
+            mPublishedBest.Publish(mBestCode);
+            mPublishedScore = mBestCode.mScore[1];
+        }
+
+        // a new best code of a climber, it is the best code for ReadBest until the fit ends when it beats
+        // the published one on its sample
+        void PublishInterim(const EvCode &evc) noexcept
+        {
+            ReportScore(evc.mScore[1]);
+            if (evc.mScore[1] < mPublishedScore)
+            {
+                mPublishedBest.Publish(evc);
+                mPublishedScore = evc.mScore[1];
+            }
+        }
+
+        // machine of the i-th thread evaluating the neighbours, the first one is the solver's own
+        Machine &GetMachine(size_t i) noexcept
+        {
+            return i ? *mWorkers[i - 1] : mMachine;
+        }
+
+        // f(p) for p in [0, count) on the pool, at most one call per neighbour thread
+        template <typename F>
+        void ParallelFor(size_t count, F &&f) noexcept
+        {
+            assert(count <= mParts.size());
+            if (mPool)
+            {
+                mPool->ParallelFor(count, f);
+                return;
+            }
+            for (size_t p = 0; p < count; p++)
+            {
+                f(p);
+            }
+        }
+
+        // f(p, i) for every climber i, the neighbour thread p handles every p-th one
+        template <typename F>
+        void ParallelForClimbers(F &&f) noexcept
+        {
+            const auto threads = std::min(mPool ? mParts.size() : 1, mPopulation.size());
+            ParallelFor(threads, [&](size_t p) noexcept
+                        {
+                for (size_t i = p; i < mPopulation.size(); i += threads)
+                    f(p, i); });
+        }
+
         auto TournamentSelection(size_t tournament = 1) noexcept
         {
             size_t bestIdx = 0;
@@ -364,6 +872,16 @@ namespace SymbolicRegression::HillClimb
             return std::pair{&mPopulation[bestIdx], bestIdx};
         }
 
+        // the sample is evaluated in decreasing error of the current code, neighbours that can't be
+        // accepted reach the bound within the first batches
+        static void SetSampleOrder(HillClimber<T> &hc, const std::vector<Utils::BatchScore> &order) noexcept
+        {
+            for (size_t i = 0; i < order.size(); i++)
+            {
+                hc.mSample[i] = order[i].mIndex;
+            }
+        }
+
         double GetScore(const std::vector<Utils::BatchScore> &scores)
         {
             auto score = 0.0;
@@ -385,6 +903,49 @@ namespace SymbolicRegression::HillClimb
         std::vector<HillClimber<T>> mPopulation;
         EvCode mBestCode;
 
+        // neighbours of a step when they are evaluated together, see Config::mBatchNeighbours
+        std::vector<EvCode> mCandidates;
+        std::vector<Utils::Result<BATCH>> mCandidateResults;
+        std::vector<const Code *> mPendingCodes;
+        std::vector<Utils::Result<BATCH> *> mPendingResults;
+        std::vector<uint8_t> mComplete;
+
+        // work of each neighbour thread, see Config::mNeighbourThreads
+        struct Part
+        {
+            std::vector<const Code *> mCodes;
+            std::vector<Utils::Result<BATCH> *> mResults;
+            std::vector<uint8_t> mComplete;
+            // Initialize and EvalPopulation
+            Utils::Result<BATCH> mResult;
+            std::vector<Utils::BatchScore> mSampleOrder;
+        };
+        std::vector<std::unique_ptr<Machine>> mWorkers;
+        std::vector<Part> mParts;
+        // EvalPopulation, the climbers of a wave and their scores
+        std::vector<size_t> mWave;
+        std::vector<double> mFullScores;
+
         std::vector<size_t> mFullSet;
+
+        Utils::ThreadPool *mPool{nullptr};
+
+        // see SetProgress
+        FitProgress *mProgress{nullptr};
+        const std::atomic<bool> *mCancel{nullptr};
+
+        // island model, see SetMigration
+        Migration<T> *mMigration{nullptr};
+        size_t mIsland{0};
+        std::vector<uint64_t> mImported;
+        EvCode mImmigrant;
+
+        // snapshots of the models, see PublishClimber and PublishBest, the ones read by Predict are kept
+        std::vector<std::unique_ptr<SharedCode<T>>> mPublished;
+        SharedCode<T> mPublishedBest;
+        double mPublishedScore{LARGE_FLOAT};
+        Machine mPredictMachine;
+        EvCode mPredictCode;
+        uint64_t mPredictSequence{0};
     };
 }
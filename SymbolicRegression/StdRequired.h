@@ -1,6 +1,9 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <limits>
 #include <memory>
 #include <cmath>
 #include <cstring>
@@ -12,3 +15,8 @@
 #include <unordered_map>
 #include <iostream>
 #include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
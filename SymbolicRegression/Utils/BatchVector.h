@@ -11,9 +11,19 @@ namespace SymbolicRegression::Utils
         {
         }
 
+        // wraps caller owned memory holding BatchCount(size) * BATCH values, see IsWrappable
+        BatchVector(T *data, const size_t size) noexcept
+            : mSize(size),
+              mPtr(data),
+              mOwned(false)
+        {
+            assert(IsWrappable(data));
+        }
+
         ~BatchVector()
         {
-            Utils::AlignedFree(mPtr);
+            if (mOwned)
+                Utils::AlignedFree(mPtr);
         }
 
         BatchVector() = delete;
@@ -55,9 +65,15 @@ namespace SymbolicRegression::Utils
             return (size % BATCH) ? cnt + 1 : cnt;
         }
 
+        static bool IsWrappable(const T *data) noexcept
+        {
+            return data && (reinterpret_cast<uintptr_t>(data) & (ALIGN - 1)) == 0;
+        }
+
     private:
         const size_t mSize{};
         T *mPtr{nullptr};
+        const bool mOwned{true};
 
         static_assert((sizeof(T) * BATCH >= ALIGN));
         static_assert((sizeof(T) * BATCH & (ALIGN - 1)) == 0);
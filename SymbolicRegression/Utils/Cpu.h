@@ -0,0 +1,84 @@
+#pragma once
+
+#include "../Defs.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace SymbolicRegression::Utils
+{
+    // Instruction set variants of the evaluation kernels, ordered by capability
+    enum class Isa : uint32_t
+    {
+        Auto = 0,
+        Sse42,
+        Avx2,
+        Avx512
+    };
+
+    constexpr size_t ISA_COUNT = 3;
+
+    constexpr size_t IsaIndex(Isa isa) noexcept
+    {
+        return static_cast<size_t>(isa) - 1;
+    }
+
+    inline const char *IsaName(Isa isa) noexcept
+    {
+        switch (isa)
+        {
+        case Isa::Sse42:
+            return "sse4.2";
+        case Isa::Avx2:
+            return "avx2";
+        case Isa::Avx512:
+            return "avx512";
+        default:
+            return "auto";
+        }
+    }
+
+    inline Isa DetectIsa() noexcept
+    {
+#if defined(MULTI_ISA)
+        // every feature of the TARGET_AVX2 and TARGET_AVX512 attributes, hypervisors may mask some of them
+        __builtin_cpu_init();
+        const auto avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("bmi") &&
+                          __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("f16c");
+        if (avx2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") &&
+            __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512bw"))
+            return Isa::Avx512;
+        return avx2 ? Isa::Avx2 : Isa::Sse42;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        // the build uses a single /arch, every variant runs the same code, this is informative only
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return Isa::Sse42;
+        __cpuid(info, 1);
+        const auto osxsave = (info[2] & (1 << 27)) != 0;
+        const auto fma = (info[2] & (1 << 12)) != 0;
+        const auto f16c = (info[2] & (1 << 29)) != 0;
+        if (!osxsave)
+            return Isa::Sse42;
+        const auto xcr0 = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+        const auto bmi = (info[1] & (1 << 3)) != 0 && (info[1] & (1 << 8)) != 0; // bmi1, bmi2
+        const auto avx2 = fma && f16c && bmi && (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+        const auto avx512 = avx2 && (static_cast<uint32_t>(info[1]) & 0xC0030000u) == 0xC0030000u && (xcr0 & 0xE6) == 0xE6; // f, dq, bw, vl
+        return avx512 ? Isa::Avx512 : (avx2 ? Isa::Avx2 : Isa::Sse42);
+#else
+        return Isa::Sse42;
+#endif
+    }
+
+    // Auto picks the best supported variant, a forced variant the CPU lacks falls back to the best supported one
+    inline Isa SelectIsa(Isa requested) noexcept
+    {
+        const auto detected = DetectIsa();
+        if (requested == Isa::Auto || static_cast<uint32_t>(requested) > static_cast<uint32_t>(detected))
+            return detected;
+        return requested;
+    }
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "BatchVector.h"
+#include "Half.h"
 
 namespace SymbolicRegression::Utils
 {
@@ -8,6 +9,7 @@ namespace SymbolicRegression::Utils
     class Dataset
     {
         using BVector = BatchVector<T, BATCH, ALIGN>;
+        using CompactVector = BatchVector<uint16_t, BATCH, ALIGN>;
 
     public:
         Dataset(size_t size, const CodeSettings &cs)
@@ -23,6 +25,21 @@ namespace SymbolicRegression::Utils
             mY = std::make_unique<BVector>(size);
         }
 
+        // Wraps the caller owned columns of x and y that are not nullptr, each one aligned to ALIGN and
+        // holding BatchCount(size) * BATCH values, the others are allocated
+        Dataset(size_t size, const CodeSettings &cs, T *const *x, T *y)
+            : mSize(size),
+              mBatchCount(BVector::BatchCount(size)),
+              mX(cs.mInputSize),
+              mY(nullptr)
+        {
+            for (size_t i = 0; i < cs.mInputSize; i++)
+            {
+                mX[i] = x[i] ? std::make_unique<BVector>(x[i], size) : std::make_unique<BVector>(size);
+            }
+            mY = y ? std::make_unique<BVector>(y, size) : std::make_unique<BVector>(size);
+        }
+
         Dataset() = delete;
         ~Dataset() = default;
         Dataset(const Dataset &) = delete;
@@ -95,10 +112,61 @@ namespace SymbolicRegression::Utils
             return mY->GetData();
         }
 
+        // Adds a 16 bit copy of the inputs for the search to evaluate, the T columns stay for full precision
+        // scoring and prediction, so the inputs take sizeof(T) + 2 bytes per value. Called once the inputs are
+        // filled, Storage::Full drops the copy.
+        void Compact(Storage storage) noexcept
+        {
+            mStorage = storage;
+            mXc.clear();
+            if (storage == Storage::Full)
+                return;
+
+            const auto size = mBatchCount * BATCH;
+            for (const auto &x : mX)
+            {
+                auto &xc = mXc.emplace_back(std::make_unique<CompactVector>(mSize));
+                const T *src = x->GetData();
+                uint16_t *dst = xc->GetData();
+                for (size_t i = 0; i < size; i++)
+                {
+                    const auto value = static_cast<float>(src[i]);
+                    dst[i] = storage == Storage::Fp16 ? FloatToHalf(value) : FloatToBf16(value);
+                }
+            }
+        }
+
+        // values and storage of other, of the same size, converted to T
+        template <typename U>
+        void CopyFrom(const Dataset<U, BATCH, ALIGN> &other) noexcept
+        {
+            assert(other.Size() == mSize && other.CountX() == mX.size());
+            const auto size = mBatchCount * BATCH;
+            for (size_t i = 0; i < mX.size(); i++)
+            {
+                std::copy(other.DataX(i), other.DataX(i) + size, DataX(i));
+            }
+            std::copy(other.DataY(), other.DataY() + size, DataY());
+            Compact(other.GetStorage());
+        }
+
+        Storage GetStorage() const noexcept
+        {
+            return mStorage;
+        }
+
+        const uint16_t *CompactX(const size_t x) const noexcept
+        {
+            assert(x < mXc.size());
+            return mXc[x]->GetData();
+        }
+
     private:
         const size_t mSize{};
         const size_t mBatchCount{};
         std::vector<std::unique_ptr<BVector>> mX{};
         std::unique_ptr<BVector> mY{};
+        Storage mStorage{Storage::Full};
+        std::vector<std::unique_ptr<CompactVector>> mXc{};
     };
 }
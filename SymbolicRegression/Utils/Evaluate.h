@@ -252,33 +252,150 @@ namespace SymbolicRegression::Utils
         return 0.0;
     }
 
+    template <typename T, uint32_t TRANSFORMATION>
+    inline T Transform(T y) noexcept
+    {
+        if constexpr (TRANSFORMATION == 1)
+        {
+            y = std::max(y, static_cast<T>(-20.0));
+            y = std::min(y, static_cast<T>(20.0));
+            return static_cast<T>(1.0) / (static_cast<T>(1.0) + std::exp(-y));
+        }
+        else if constexpr (TRANSFORMATION == 2)
+        {
+            y = static_cast<T>(0.25) * y + static_cast<T>(0.5);
+            y = std::max(y, static_cast<T>(0.0));
+            return std::min(y, static_cast<T>(1.0));
+        }
+        else if constexpr (TRANSFORMATION == 3)
+        {
+            return std::round(y);
+        }
+        else
+        {
+            return y;
+        }
+    }
+
     template <typename T, size_t S>
     void TransformData(T *y, uint32_t transformation) noexcept
     {
         if (transformation == 1)
         {
             for (size_t i = 0; i < S; i++)
-            {
-                y[i] = std::max(y[i], static_cast<T>(-20.0));
-                y[i] = std::min(y[i], static_cast<T>(20.0));
-                y[i] = static_cast<T>(1.0) / (static_cast<T>(1.0) + std::exp(-y[i]));
-            }
+                y[i] = Transform<T, 1>(y[i]);
         }
         else if (transformation == 2)
         {
             for (size_t i = 0; i < S; i++)
-            {
-                y[i] = static_cast<T>(0.25) * y[i] + static_cast<T>(0.5);
-                y[i] = std::max(y[i], static_cast<T>(0.0));
-                y[i] = std::min(y[i], static_cast<T>(1.0));
-            }
+                y[i] = Transform<T, 2>(y[i]);
         }
         else if (transformation == 3)
         {
             for (size_t i = 0; i < S; i++)
+                y[i] = Transform<T, 3>(y[i]);
+        }
+    }
+
+    // Metric ids of ScoreFused, METRIC_LOGIT_APPROX ignores the transformation and clipping
+    constexpr uint32_t METRIC_MSE = 0;
+    constexpr uint32_t METRIC_MAE = 1;
+    constexpr uint32_t METRIC_MSLE = 2;
+    constexpr uint32_t METRIC_KENDALL = 3;
+    constexpr uint32_t METRIC_LOG_LOSS = 4;
+    constexpr uint32_t METRIC_LOGIT_APPROX = 20;
+
+    // TransformData, Clip and the Compute* metric of a batch in one pass, each prediction is transformed,
+    // clipped and accumulated while in a register. Pseudo kendall compares all pairs, so for it yPred is
+    // transformed in place first. Unknown metrics score 0.
+    template <typename T, size_t S, uint32_t METRIC, uint32_t TRANSFORMATION, bool CLIP, bool CW, bool SW>
+    double ScoreFused(const T *const __restrict yTrue,
+                      T *const __restrict yPred,
+                      const T *const __restrict sampleWeight,
+                      T clipMin,
+                      T clipMax,
+                      T cw0,
+                      T cw1) noexcept
+    {
+        if constexpr (METRIC == METRIC_LOGIT_APPROX)
+        {
+            return ComputeLogitApprox<T, CW, SW>(yTrue, yPred, S, cw0, cw1, sampleWeight);
+        }
+        else if constexpr (METRIC == METRIC_KENDALL)
+        {
+            for (size_t n = 0; n < S; n++)
             {
-                y[i] = std::round(y[i]);
+                auto y = Transform<T, TRANSFORMATION>(yPred[n]);
+                if constexpr (CLIP)
+                {
+                    y = std::max(y, clipMin);
+                    y = std::min(y, clipMax);
+                }
+                yPred[n] = y;
+            }
+            return 1.0 - std::abs(ComputePseudoKendall(yTrue, yPred, S));
+        }
+        else if constexpr (METRIC == METRIC_MSE || METRIC == METRIC_MAE || METRIC == METRIC_MSLE || METRIC == METRIC_LOG_LOSS)
+        {
+            // MSLE accumulates in double like ComputeMSLE
+            std::conditional_t<METRIC == METRIC_MSLE, double, T> err{};
+            for (size_t n = 0; n < S; n++)
+            {
+                auto y = Transform<T, TRANSFORMATION>(yPred[n]);
+                if constexpr (CLIP)
+                {
+                    y = std::max(y, clipMin);
+                    y = std::min(y, clipMax);
+                }
+
+                if constexpr (METRIC == METRIC_MSE)
+                {
+                    auto _err = (y - yTrue[n]) * (y - yTrue[n]);
+                    if constexpr (SW)
+                    {
+                        _err *= sampleWeight[n];
+                    }
+                    err += _err;
+                }
+                else if constexpr (METRIC == METRIC_MAE)
+                {
+                    // unweighted, as in ComputeMAE
+                    err += std::abs(y - yTrue[n]);
+                }
+                else if constexpr (METRIC == METRIC_MSLE)
+                {
+                    auto _err = std::log(1.0 + yTrue[n]) - std::log(1.0 + y);
+                    _err *= _err;
+                    if constexpr (SW)
+                    {
+                        _err *= sampleWeight[n];
+                    }
+                    err += _err;
+                }
+                else
+                {
+                    auto _err = yTrue[n] > (T)0.999999 ? -std::log(y) : -std::log(static_cast<T>(1.0) - y);
+                    if constexpr (CW)
+                    {
+                        _err *= yTrue[n] > (T)0.999999 ? cw1 : cw0;
+                    }
+                    if constexpr (SW)
+                    {
+                        _err *= sampleWeight[n];
+                    }
+                    err += _err;
+                }
             }
+
+            if (IsFinite(err))
+            {
+                return static_cast<double>(err);
+            }
+            return LARGE_FLOAT;
+        }
+        else
+        {
+            return 0.0;
         }
     }
 
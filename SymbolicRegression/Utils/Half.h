@@ -0,0 +1,78 @@
+#pragma once
+
+namespace SymbolicRegression::Utils
+{
+    // Storage of the dataset inputs evaluated during the search, Full reads the T columns directly,
+    // the 16 bit formats keep a compact copy that is widened to T batch by batch. It saves bandwidth, not memory,
+    // the T columns stay next to it
+    enum class Storage : uint32_t
+    {
+        Full = 0,
+        Fp16,
+        Bf16
+    };
+
+    // IEEE half, rounded to nearest even, overflow to inf, NaN stays NaN
+    inline uint16_t FloatToHalf(float f) noexcept
+    {
+        constexpr uint32_t f16max = (127 + 16) << 23;
+        constexpr uint32_t denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+
+        auto u = std::bit_cast<uint32_t>(f);
+        const auto sign = u & 0x80000000u;
+        u ^= sign;
+
+        uint32_t h;
+        if (u >= f16max)
+        {
+            h = u > 0x7f800000u ? 0x7e00 : 0x7c00;
+        }
+        else if (u < (113u << 23))
+        {
+            // subnormal or zero, the float addition does the rounding
+            const auto v = std::bit_cast<float>(u) + std::bit_cast<float>(denormMagic);
+            h = std::bit_cast<uint32_t>(v) - denormMagic;
+        }
+        else
+        {
+            const auto mantOdd = (u >> 13) & 1;
+            u += (static_cast<uint32_t>(15 - 127) << 23) + 0xfff + mantOdd;
+            h = u >> 13;
+        }
+        return static_cast<uint16_t>(h | (sign >> 16));
+    }
+
+    inline float HalfToFloat(uint16_t h) noexcept
+    {
+        constexpr uint32_t shiftedExp = 0x7c00u << 13;
+        constexpr uint32_t magic = 113u << 23;
+
+        auto u = static_cast<uint32_t>(h & 0x7fff) << 13;
+        const auto exp = u & shiftedExp;
+        u += (127 - 15) << 23;
+        if (exp == shiftedExp)
+        {
+            u += (128 - 16) << 23; // inf, NaN
+        }
+        else if (exp == 0)
+        {
+            u += 1 << 23; // zero, subnormal
+            u = std::bit_cast<uint32_t>(std::bit_cast<float>(u) - std::bit_cast<float>(magic));
+        }
+        return std::bit_cast<float>(u | (static_cast<uint32_t>(h & 0x8000) << 16));
+    }
+
+    // upper half of a float, rounded to nearest even, NaN stays NaN
+    inline uint16_t FloatToBf16(float f) noexcept
+    {
+        const auto u = std::bit_cast<uint32_t>(f);
+        if ((u & 0x7fffffffu) > 0x7f800000u)
+            return static_cast<uint16_t>((u >> 16) | 0x40);
+        return static_cast<uint16_t>((u + 0x7fff + ((u >> 16) & 1)) >> 16);
+    }
+
+    inline float Bf16ToFloat(uint16_t b) noexcept
+    {
+        return std::bit_cast<float>(static_cast<uint32_t>(b) << 16);
+    }
+}
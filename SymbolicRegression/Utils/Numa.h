@@ -0,0 +1,250 @@
+#pragma once
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_MSC_VER)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+namespace SymbolicRegression::Utils
+{
+    // Cpus of the NUMA nodes the process may run on, a single node of all the cpus where the nodes can't
+    // be read. On Windows a cpu is numbered 64 * processor group + number in the group.
+    class NumaTopology
+    {
+    public:
+        NumaTopology()
+        {
+#if defined(__linux__)
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            const auto affinity = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+            for (size_t node = 0;; node++)
+            {
+                std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                std::string list;
+                if (!f || !std::getline(f, list))
+                    break;
+                auto &cpus = mNodeCpus.emplace_back();
+                ParseCpuList(list, cpus);
+                std::erase_if(cpus, [&](uint32_t cpu)
+                              { return affinity && (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)); });
+                if (cpus.empty())
+                    mNodeCpus.pop_back();
+            }
+#elif defined(_MSC_VER)
+            // the affinity mask of the process covers its group only, processes spanning groups take all the cpus
+            USHORT groups[2]{};
+            USHORT groupCount = 2;
+            DWORD_PTR processMask = 0, systemMask = 0;
+            const auto singleGroup = GetProcessGroupAffinity(GetCurrentProcess(), &groupCount, groups) && groupCount == 1 &&
+                                     GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask);
+            ULONG highest = 0;
+            if (GetNumaHighestNodeNumber(&highest))
+            {
+                for (USHORT node = 0; node <= highest; node++)
+                {
+                    GROUP_AFFINITY affinity{};
+                    if (!GetNumaNodeProcessorMaskEx(node, &affinity))
+                        continue;
+                    auto mask = static_cast<uint64_t>(affinity.Mask);
+                    if (singleGroup)
+                        mask = affinity.Group == groups[0] ? mask & processMask : 0;
+                    if (!mask)
+                        continue;
+                    auto &cpus = mNodeCpus.emplace_back();
+                    for (uint32_t cpu = 0; cpu < 64; cpu++)
+                    {
+                        if (mask & (1ull << cpu))
+                            cpus.push_back(64u * affinity.Group + cpu);
+                    }
+                }
+            }
+#endif
+            if (mNodeCpus.empty())
+            {
+                auto &cpus = mNodeCpus.emplace_back(std::max(std::thread::hardware_concurrency(), 1u));
+                std::iota(cpus.begin(), cpus.end(), 0);
+            }
+            for (size_t node = 0; node < mNodeCpus.size(); node++)
+            {
+                for (const auto cpu : mNodeCpus[node])
+                {
+                    if (cpu >= mNodeOf.size())
+                        mNodeOf.resize(cpu + 1, 0);
+                    mNodeOf[cpu] = static_cast<uint32_t>(node);
+                }
+            }
+        }
+
+        size_t Nodes() const noexcept
+        {
+            return mNodeCpus.size();
+        }
+
+        // cpus node by node, threads pinned in this order fill a node before the next one
+        std::vector<uint32_t> OrderedCpus() const
+        {
+            std::vector<uint32_t> cpus;
+            for (const auto &node : mNodeCpus)
+                cpus.insert(cpus.end(), node.begin(), node.end());
+            return cpus;
+        }
+
+        const std::vector<uint32_t> &Cpus(size_t node) const noexcept
+        {
+            return mNodeCpus[node];
+        }
+
+        size_t NodeOf(uint32_t cpu) const noexcept
+        {
+            return cpu < mNodeOf.size() ? mNodeOf[cpu] : 0;
+        }
+
+        // node of the cpu the calling thread runs on, it may move unless it is pinned
+        size_t CurrentNode() const noexcept
+        {
+#if defined(__linux__)
+            const auto cpu = sched_getcpu();
+            return cpu < 0 ? 0 : NodeOf(static_cast<uint32_t>(cpu));
+#elif defined(_MSC_VER)
+            PROCESSOR_NUMBER number{};
+            GetCurrentProcessorNumberEx(&number);
+            return NodeOf(64u * number.Group + number.Number);
+#else
+            return 0;
+#endif
+        }
+
+    private:
+        // "0-3,8,10-11"
+        static void ParseCpuList(const std::string &list, std::vector<uint32_t> &cpus)
+        {
+            std::stringstream ss{list};
+            std::string range;
+            while (std::getline(ss, range, ','))
+            {
+                char *end = nullptr;
+                const auto first = static_cast<uint32_t>(std::strtoul(range.c_str(), &end, 10));
+                const auto last = *end == '-' ? static_cast<uint32_t>(std::strtoul(end + 1, nullptr, 10)) : first;
+                for (auto cpu = first; cpu <= last; cpu++)
+                    cpus.push_back(cpu);
+            }
+        }
+
+        std::vector<std::vector<uint32_t>> mNodeCpus{};
+        std::vector<uint32_t> mNodeOf{};
+    };
+
+    // Limits the calling thread to cpus, false where it isn't supported. A Windows thread runs in one processor
+    // group, the one of the first cpu.
+    inline bool PinThread(const std::vector<uint32_t> &cpus) noexcept
+    {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const auto cpu : cpus)
+        {
+            if (cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_MSC_VER)
+        if (cpus.empty())
+            return false;
+        GROUP_AFFINITY affinity{};
+        affinity.Group = static_cast<WORD>(cpus[0] / 64);
+        for (const auto cpu : cpus)
+        {
+            if (cpu / 64 == affinity.Group)
+                affinity.Mask |= KAFFINITY{1} << (cpu % 64);
+        }
+        return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#else
+        return false;
+#endif
+    }
+
+    // Pins the calling thread to cpus while it lives and restores the affinity the thread had, no cpus leave it as is
+    class ScopedPin
+    {
+    public:
+        explicit ScopedPin(const std::vector<uint32_t> &cpus) noexcept
+        {
+            if (cpus.empty())
+                return;
+#if defined(__linux__)
+            CPU_ZERO(&mSaved);
+            mPinned = pthread_getaffinity_np(pthread_self(), sizeof(mSaved), &mSaved) == 0 && PinThread(cpus);
+#elif defined(_MSC_VER)
+            mPinned = GetThreadGroupAffinity(GetCurrentThread(), &mSaved) && PinThread(cpus);
+#endif
+        }
+
+        ScopedPin(const ScopedPin &) = delete;
+        ScopedPin &operator=(const ScopedPin &) = delete;
+
+        ~ScopedPin()
+        {
+            if (!mPinned)
+                return;
+#if defined(__linux__)
+            pthread_setaffinity_np(pthread_self(), sizeof(mSaved), &mSaved);
+#elif defined(_MSC_VER)
+            SetThreadGroupAffinity(GetCurrentThread(), &mSaved, nullptr);
+#endif
+        }
+
+    private:
+        bool mPinned{false};
+#if defined(__linux__)
+        cpu_set_t mSaved;
+#elif defined(_MSC_VER)
+        GROUP_AFFINITY mSaved{};
+#endif
+    };
+
+    // Counts the pool threads pinned to each cpu of the process, the pools of several solver handles take the least
+    // used cpus of a node so they don't stack their threads on the same cores
+    class CpuClaims
+    {
+    public:
+        // the least claimed of cpus, the first of them on a tie
+        static uint32_t Claim(const std::vector<uint32_t> &cpus) noexcept
+        {
+            std::lock_guard lock(sMutex);
+            auto best = cpus.front();
+            for (const auto cpu : cpus)
+            {
+                if (Count(cpu) < Count(best))
+                    best = cpu;
+            }
+            Count(best)++;
+            return best;
+        }
+
+        static void Release(uint32_t cpu) noexcept
+        {
+            std::lock_guard lock(sMutex);
+            Count(cpu)--;
+        }
+
+    private:
+        static uint32_t &Count(uint32_t cpu) noexcept
+        {
+            if (cpu >= sCounts.size())
+                sCounts.resize(cpu + 1, 0);
+            return sCounts[cpu];
+        }
+
+        inline static std::mutex sMutex{};
+        inline static std::vector<uint32_t> sCounts{};
+    };
+}
@@ -0,0 +1,307 @@
+#pragma once
+
+#include "Numa.h"
+
+namespace SymbolicRegression::Utils
+{
+    // Fixed set of worker threads running the parallel loops of a solver handle, the thread calling
+    // ParallelFor works too, so a pool of n threads never runs more than n tasks at once. Every thread
+    // has its own task queue, it takes its newest tasks and steals the oldest ones of the others when it
+    // runs dry. A thread waiting for its loop runs the tasks of that loop and of the loops nested in them,
+    // so nested loops share the same threads instead of oversubscribing the cores, and sleeps when there
+    // are none. It never picks up an unrelated loop, like another solver's fit, that would hold it up.
+    class ThreadPool
+    {
+        struct Loop
+        {
+            std::atomic<size_t> mPending;
+            // loop of the task that started this one, nullptr at the top
+            const Loop *mParent;
+        };
+
+        struct Task
+        {
+            void (*mRun)(void *, size_t);
+            void *mFunc;
+            size_t mIndex;
+            Loop *mLoop;
+            // only the thread of the queue runs it, see ForEachNode
+            bool mPinned;
+        };
+
+        struct alignas(64) Queue
+        {
+            std::mutex mMutex;
+            std::deque<Task> mTasks;
+        };
+
+    public:
+        // threads counts the calling thread, a pool of one thread runs the loops sequentially. With numa the
+        // worker threads are pinned to a cpu each, spread over the nodes in turn, the calling thread isn't, see ScopedPin.
+        // The cpus are the least used ones by the pools of the process, see CpuClaims.
+        explicit ThreadPool(size_t threads, const NumaTopology *numa = nullptr)
+            : mQueues(std::max<size_t>(threads, 1)),
+              mNuma(numa),
+              mWorkerNode(mQueues.size(), 0),
+              mWorkerCpu(mQueues.size(), 0)
+        {
+            for (size_t i = 1; i < mQueues.size() && numa; i++)
+            {
+                const auto node = i % numa->Nodes();
+                mWorkerNode[i] = node;
+                mWorkerCpu[i] = CpuClaims::Claim(numa->Cpus(node));
+            }
+            for (size_t i = 1; i < mQueues.size(); i++)
+            {
+                mWorkers.emplace_back([this, i]()
+                                      { Work(i); });
+            }
+        }
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard lock(mSleepMutex);
+                mStop = true;
+            }
+            mWake.notify_all();
+            for (auto &w : mWorkers)
+            {
+                w.join();
+            }
+            for (size_t i = 1; i < mQueues.size() && mNuma; i++)
+            {
+                CpuClaims::Release(mWorkerCpu[i]);
+            }
+        }
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        size_t Size() const noexcept
+        {
+            return mQueues.size();
+        }
+
+        // NUMA node of the calling thread, 0 without numa
+        size_t CurrentNode() const noexcept
+        {
+            if (!mNuma)
+                return 0;
+            return tPool == this && tIndex ? mWorkerNode[tIndex] : mNuma->CurrentNode();
+        }
+
+        // runs f(i) for i in [0, count) and returns once all of them finished
+        template <typename F>
+        void ParallelFor(size_t count, F &&f) noexcept
+        {
+            if (count == 0)
+                return;
+            if (count == 1 || mWorkers.empty())
+            {
+                for (size_t i = 0; i < count; i++)
+                    f(i);
+                return;
+            }
+
+            Loop loop{{count - 1}, tLoop};
+            {
+                auto &queue = mQueues[Self()];
+                std::lock_guard lock(queue.mMutex);
+                for (size_t i = count; i-- > 1;)
+                    queue.mTasks.push_back(MakeTask(f, i, loop, false));
+            }
+            Queued(count - 1);
+
+            RunInline(loop, f, 0);
+            Wait(loop);
+        }
+
+        // Runs f(node) for every NUMA node on a worker thread pinned to it, so that what it allocates and
+        // writes lands on the node. The nodes without a worker, and node 0 without numa, run on the calling
+        // thread.
+        template <typename F>
+        void ForEachNode(F &&f) noexcept
+        {
+            const auto nodes = mNuma ? mNuma->Nodes() : 1;
+            std::vector<size_t> worker(nodes, 0);
+            for (size_t i = mQueues.size(); i-- > 1 && mNuma;)
+            {
+                worker[mWorkerNode[i]] = i;
+            }
+
+            const auto pinned = static_cast<size_t>(std::count_if(worker.begin(), worker.end(), [](size_t w)
+                                                                  { return w != 0; }));
+            Loop loop{{pinned}, tLoop};
+            for (size_t node = 0; node < nodes; node++)
+            {
+                if (!worker[node])
+                    continue;
+                auto &queue = mQueues[worker[node]];
+                std::lock_guard lock(queue.mMutex);
+                queue.mTasks.push_back(MakeTask(f, node, loop, true));
+            }
+            Queued(pinned);
+
+            for (size_t node = 0; node < nodes; node++)
+            {
+                if (!worker[node])
+                    RunInline(loop, f, node);
+            }
+            Wait(loop);
+        }
+
+    private:
+        template <typename F>
+        static Task MakeTask(F &f, size_t i, Loop &loop, bool pinned) noexcept
+        {
+            using Func = std::remove_reference_t<F>;
+            const auto run = [](void *func, size_t i) noexcept
+            {
+                (*static_cast<Func *>(func))(i);
+            };
+            return {run, const_cast<void *>(static_cast<const void *>(&f)), i, &loop, pinned};
+        }
+
+        void Queued(size_t count) noexcept
+        {
+            mQueued.fetch_add(count, std::memory_order_release);
+            {
+                std::lock_guard lock(mSleepMutex);
+                mGeneration++;
+            }
+            mWake.notify_all();
+        }
+
+        // f(i) as a task of loop, the loops it starts are nested in it
+        template <typename F>
+        static void RunInline(const Loop &loop, F &f, size_t i) noexcept
+        {
+            const auto *outer = tLoop;
+            tLoop = &loop;
+            f(i);
+            tLoop = outer;
+        }
+
+        // The tasks of the loop left running on other threads are waited for asleep, a wake up comes when
+        // the last one finishes or new tasks are queued, which may be nested in them.
+        void Wait(Loop &loop) noexcept
+        {
+            while (loop.mPending.load(std::memory_order_acquire))
+            {
+                const auto generation = mGeneration.load(std::memory_order_acquire);
+                if (RunOne(&loop))
+                    continue;
+                std::unique_lock lock(mSleepMutex);
+                mWake.wait(lock, [&]()
+                           { return !loop.mPending.load(std::memory_order_acquire) || mGeneration.load(std::memory_order_relaxed) != generation; });
+            }
+        }
+
+        // queue of the calling thread, threads outside the pool share the first one
+        size_t Self() const noexcept
+        {
+            return tPool == this ? tIndex : 0;
+        }
+
+        // loop is owner or nested in it, any loop without an owner
+        static bool Within(const Loop *loop, const Loop *owner) noexcept
+        {
+            if (!owner)
+                return true;
+            for (; loop; loop = loop->mParent)
+            {
+                if (loop == owner)
+                    return true;
+            }
+            return false;
+        }
+
+        // the newest or oldest task of the queue idx within owner
+        bool Pop(size_t idx, bool newest, const Loop *owner, Task &task) noexcept
+        {
+            auto &queue = mQueues[idx];
+            std::lock_guard lock(queue.mMutex);
+            auto &tasks = queue.mTasks;
+            const auto n = tasks.size();
+            for (size_t k = 0; k < n; k++)
+            {
+                const auto it = tasks.begin() + (newest ? n - 1 - k : k);
+                if (!Within(it->mLoop, owner) || (it->mPinned && idx != Self()))
+                    continue;
+                task = *it;
+                tasks.erase(it);
+                mQueued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+            return false;
+        }
+
+        // runs a queued task within owner, nullptr takes any
+        bool RunOne(const Loop *owner) noexcept
+        {
+            if (!mQueued.load(std::memory_order_acquire))
+                return false;
+            const auto self = Self();
+            Task task;
+            auto found = Pop(self, true, owner, task);
+            for (size_t k = 1; k < mQueues.size() && !found; k++)
+            {
+                found = Pop((self + k) % mQueues.size(), false, owner, task);
+            }
+            if (!found)
+                return false;
+
+            const auto *outer = tLoop;
+            tLoop = task.mLoop;
+            task.mRun(task.mFunc, task.mIndex);
+            tLoop = outer;
+            if (task.mLoop->mPending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                // the thread waiting for the loop checks it under the mutex
+                {
+                    std::lock_guard lock(mSleepMutex);
+                }
+                mWake.notify_all();
+            }
+            return true;
+        }
+
+        void Work(size_t idx) noexcept
+        {
+            tPool = this;
+            tIndex = idx;
+            if (mNuma)
+                PinThread({mWorkerCpu[idx]});
+            // the tasks left queued may be pinned to other threads, so it sleeps until new ones come
+            while (true)
+            {
+                const auto generation = mGeneration.load(std::memory_order_acquire);
+                if (RunOne(nullptr))
+                    continue;
+                std::unique_lock lock(mSleepMutex);
+                mWake.wait(lock, [&]()
+                           { return mStop || mGeneration.load(std::memory_order_relaxed) != generation; });
+                if (mStop)
+                    return;
+            }
+        }
+
+        std::vector<Queue> mQueues;
+        const NumaTopology *mNuma;
+        std::vector<size_t> mWorkerNode;
+        std::vector<uint32_t> mWorkerCpu;
+        std::vector<std::thread> mWorkers{};
+        std::atomic<size_t> mQueued{0};
+        // counts the loops queued, see Wait and Work
+        std::atomic<uint64_t> mGeneration{0};
+        std::mutex mSleepMutex{};
+        std::condition_variable mWake{};
+        bool mStop{false};
+
+        inline static thread_local const ThreadPool *tPool{nullptr};
+        inline static thread_local size_t tIndex{0};
+        // loop of the task the thread runs
+        inline static thread_local const Loop *tLoop{nullptr};
+    };
+}
@@ -0,0 +1,258 @@
+// g++ -std=c++20 -O2 -msse4.2 -mpopcnt -fno-exceptions half_test.cpp -o half_test
+// without -funsafe-math-optimizations, it flushes the float subnormals the bf16 checks read
+#include <cstring>
+#include <iostream>
+
+#include "../../SymbolicRegression/SymbolicRegression.h"
+
+namespace Srl = SymbolicRegression;
+using Srl::Utils::Storage;
+using Srl::Utils::Isa;
+
+constexpr size_t BATCH = 64;
+
+int failures = 0;
+
+void Check(bool ok, const char *what, double value = 0.0)
+{
+    if (ok)
+        return;
+    if (failures < 20)
+        std::cout << "FAIL: " << what << " " << value << std::endl;
+    failures++;
+}
+
+// on the bits, the library headers are built with -fno-signed-zeros
+bool IsNan(float f)
+{
+    return (std::bit_cast<uint32_t>(f) & 0x7fffffffu) > 0x7f800000u;
+}
+
+uint32_t Sign(float f)
+{
+    return std::bit_cast<uint32_t>(f) >> 31;
+}
+
+// f rounded to nearest even on the grid of a format with MANT mantissa bits and MIN_EXP as the smallest
+// normal exponent, inf from LIMIT up
+double RoundTo(float f, int mant, int minExp, double limit)
+{
+    const double a = std::abs(f);
+    if (a == 0.0)
+        return 0.0;
+    if (a >= limit)
+        return INFINITY;
+    const auto q = std::ldexp(1.0, std::max(std::ilogb(a), minExp) - mant);
+    return std::nearbyint(a / q) * q;
+}
+
+// the conversions against the exact rounding, 1 + 2^-11 is halfway between two halves
+bool HalfOk(float f)
+{
+    const auto h = Srl::Utils::FloatToHalf(f);
+    if (IsNan(f))
+        return (h & 0x7c00) == 0x7c00 && (h & 0x3ff) && (h >> 15) == Sign(f);
+    const double expected = RoundTo(f, 10, -14, 65520.0);
+    return std::abs(static_cast<double>(Srl::Utils::HalfToFloat(h))) == expected && (h >> 15) == Sign(f);
+}
+
+bool Bf16Ok(float f)
+{
+    const auto b = Srl::Utils::FloatToBf16(f);
+    if (IsNan(f))
+        return IsNan(Srl::Utils::Bf16ToFloat(b)) && (b >> 15) == Sign(f);
+    const double expected = RoundTo(f, 7, -126, std::ldexp(255.0 / 128.0 + 1.0 / 256.0, 127));
+    return std::abs(static_cast<double>(Srl::Utils::Bf16ToFloat(b))) == expected && (b >> 15) == Sign(f);
+}
+
+#if defined(HAS_F16C)
+TARGET_AVX2 uint16_t HardwareToHalf(float f)
+{
+    return static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_cvtps_ph(_mm_set_ss(f), _MM_FROUND_TO_NEAREST_INT)));
+}
+
+TARGET_AVX2 float HardwareToFloat(uint16_t h)
+{
+    return _mm_cvtss_f32(_mm_cvtph_ps(_mm_cvtsi32_si128(h)));
+}
+#endif
+
+void TestConversions()
+{
+    using namespace Srl::Utils;
+
+    // special values
+    Check(FloatToHalf(0.0f) == 0x0000 && FloatToHalf(-0.0f) == 0x8000, "half zero");
+    Check(FloatToHalf(1.0f) == 0x3c00 && FloatToHalf(-2.0f) == 0xc000, "half one");
+    Check(FloatToHalf(65504.0f) == 0x7bff, "half max");
+    Check(FloatToHalf(65519.99f) == 0x7bff, "half below overflow");
+    Check(FloatToHalf(65520.0f) == 0x7c00 && FloatToHalf(-1e10f) == 0xfc00, "half overflow to inf");
+    Check(FloatToHalf(INFINITY) == 0x7c00 && FloatToHalf(-INFINITY) == 0xfc00, "half inf");
+    Check(IsNan(HalfToFloat(FloatToHalf(NAN))) && IsNan(HalfToFloat(FloatToHalf(-NAN))), "half NaN");
+    Check(FloatToHalf(std::ldexp(1.0f, -14)) == 0x0400, "half smallest normal");
+    Check(FloatToHalf(std::ldexp(1.0f, -24)) == 0x0001, "half smallest subnormal");
+    Check(FloatToHalf(std::ldexp(1.0f, -25)) == 0x0000, "half subnormal tie to even");
+    Check(FloatToHalf(std::nextafter(std::ldexp(1.0f, -25), 1.0f)) == 0x0001, "half subnormal above tie");
+    Check(FloatToHalf(3 * std::ldexp(1.0f, -25)) == 0x0002, "half subnormal tie to even up");
+    Check(FloatToHalf(1.0f + std::ldexp(1.0f, -11)) == 0x3c00, "half tie to even");
+    Check(FloatToHalf(1.0f + 3 * std::ldexp(1.0f, -11)) == 0x3c02, "half tie to even up");
+    Check(HalfToFloat(0x7c00) == INFINITY && HalfToFloat(0xfc00) == -INFINITY, "half inf to float");
+    Check(HalfToFloat(0x0001) == std::ldexp(1.0f, -24) && HalfToFloat(0x83ff) == -1023 * std::ldexp(1.0f, -24), "half subnormal to float");
+    Check(IsNan(HalfToFloat(0x7e00)) && IsNan(HalfToFloat(0x7c01)) && IsNan(HalfToFloat(0xfe00)), "half NaN to float");
+
+    Check(FloatToBf16(1.0f) == 0x3f80 && FloatToBf16(-0.0f) == 0x8000, "bf16 one");
+    Check(FloatToBf16(1.0f + std::ldexp(1.0f, -8)) == 0x3f80, "bf16 tie to even");
+    Check(FloatToBf16(1.0f + 3 * std::ldexp(1.0f, -8)) == 0x3f82, "bf16 tie to even up");
+    Check(FloatToBf16(std::numeric_limits<float>::max()) == 0x7f80, "bf16 overflow to inf");
+    Check(FloatToBf16(INFINITY) == 0x7f80 && FloatToBf16(-INFINITY) == 0xff80, "bf16 inf");
+    Check(IsNan(Bf16ToFloat(FloatToBf16(NAN))), "bf16 NaN");
+    // a NaN with only low mantissa bits must not round to inf
+    Check(IsNan(Bf16ToFloat(FloatToBf16(std::bit_cast<float>(0x7f800001u)))), "bf16 low NaN");
+    Check(IsNan(Bf16ToFloat(FloatToBf16(std::bit_cast<float>(0xffffffffu)))), "bf16 all ones NaN");
+    Check(FloatToBf16(std::bit_cast<float>(0x00000001u)) == 0x0000, "bf16 subnormal");
+    Check(FloatToBf16(std::bit_cast<float>(0x00008000u)) == 0x0000 && FloatToBf16(std::bit_cast<float>(0x00018000u)) == 0x0002, "bf16 subnormal ties");
+
+    // every half and the floats around each midpoint of two halves
+    for (uint32_t h = 0; h < 0x10000; h++)
+    {
+        const auto f = HalfToFloat(static_cast<uint16_t>(h));
+        Check(IsNan(f) || FloatToHalf(f) == h, "half round trip", h);
+        if ((h & 0x7fff) >= 0x7c00)
+            continue;
+        const auto next = (h & 0x7fff) == 0x7bff ? 65520.0 * (h & 0x8000 ? -1 : 1) : HalfToFloat(static_cast<uint16_t>(h + 1));
+        const auto mid = static_cast<float>((static_cast<double>(f) + next) / 2);
+        for (const auto x : {mid, std::nextafter(mid, 0.0f), std::nextafter(mid, INFINITY), std::nextafter(mid, -INFINITY)})
+            Check(HalfOk(x), "half rounding", x);
+    }
+
+    // every 997th float, which covers every exponent
+    for (uint64_t u = 0; u < (1ull << 32); u += 997)
+    {
+        const auto f = std::bit_cast<float>(static_cast<uint32_t>(u));
+        Check(HalfOk(f), "half sweep", f);
+        Check(Bf16Ok(f), "bf16 sweep", f);
+    }
+
+#if defined(HAS_F16C)
+    if (DetectIsa() >= Isa::Avx2)
+    {
+        for (uint32_t h = 0; h < 0x10000; h++)
+        {
+            const auto f = HardwareToFloat(static_cast<uint16_t>(h));
+            const auto s = HalfToFloat(static_cast<uint16_t>(h));
+            Check(std::bit_cast<uint32_t>(f) == std::bit_cast<uint32_t>(s) || (IsNan(f) && IsNan(s)), "HalfToFloat vs F16C", h);
+        }
+        for (uint64_t u = 0; u < (1ull << 32); u += 997)
+        {
+            const auto f = std::bit_cast<float>(static_cast<uint32_t>(u));
+            const auto h = FloatToHalf(f);
+            const auto hw = HardwareToHalf(f);
+            Check(h == hw || (IsNan(f) && (h & 0x7fff) > 0x7c00 && (hw & 0x7fff) > 0x7c00), "FloatToHalf vs F16C", f);
+        }
+    }
+#endif
+}
+
+// the widening of every ISA against the scalar batch over all the halves
+template <typename T>
+void TestWiden()
+{
+    using Processor = Srl::Computer::Processor<T, BATCH>;
+    alignas(64) uint16_t src[BATCH];
+    alignas(64) T scalar[BATCH], dst[BATCH];
+    for (size_t isa = 0; isa < Srl::Utils::ISA_COUNT; isa++)
+    {
+        if (static_cast<uint32_t>(Srl::Utils::DetectIsa()) < isa + 1)
+            continue;
+        for (uint32_t first = 0; first < 0x10000; first += BATCH)
+        {
+            for (size_t n = 0; n < BATCH; n++)
+                src[n] = static_cast<uint16_t>(first + n);
+            Processor::template WidenBatch<Storage::Fp16>(src, scalar);
+            Processor::mWidens[isa][0](src, dst);
+            for (size_t n = 0; n < BATCH; n++)
+                Check(std::memcmp(&scalar[n], &dst[n], sizeof(T)) == 0 || (IsNan(static_cast<float>(scalar[n])) && IsNan(static_cast<float>(dst[n]))), "fp16 widen", first + n);
+            Processor::template WidenBatch<Storage::Bf16>(src, scalar);
+            Processor::mWidens[isa][1](src, dst);
+            Check(std::memcmp(scalar, dst, sizeof(scalar)) == 0, "bf16 widen", first);
+        }
+    }
+}
+
+// ComputeScore of a code on the 16 bit inputs of each storage against Compute of it on the same inputs
+// rounded in full precision, scored with ComputeSqErr
+template <typename T>
+void TestCompactScore()
+{
+    using Dataset = Srl::Utils::Dataset<T, BATCH>;
+    using Instruction = Srl::Computer::Instruction;
+    using Id = Srl::Computer::Instructions::InstructionID;
+    constexpr size_t ROWS = 20 * BATCH;
+    const Srl::CodeSettings cs{4, 2, 1, 8};
+
+    // (x0 * x1 + c0 - sin(x2)) * x3
+    Srl::Computer::Code<T> code{cs};
+    const auto m = cs.CodeStart();
+    const Instruction instructions[]{
+        {Id::mul, {0, 1}, {false, false}},
+        {Id::add, {m, 0}, {false, true}},
+        {Id::sin, {2, 0}, {false, false}},
+        {Id::sub, {m + 1, m + 2}, {false, false}},
+        {Id::mul, {m + 3, 3}, {false, false}}};
+    code.mCodeSize = std::size(instructions);
+    std::copy(std::begin(instructions), std::end(instructions), code.mCodeInstructions.begin());
+    code.mConstants = {static_cast<T>(0.75), static_cast<T>(0.0)};
+
+    Srl::Utils::RandomEngine re;
+    re.Seed(42);
+    for (const auto storage : {Storage::Full, Storage::Fp16, Storage::Bf16})
+    {
+        Dataset data{ROWS, cs}, rounded{ROWS, cs};
+        for (size_t x = 0; x < cs.mInputSize; x++)
+        {
+            for (size_t n = 0; n < ROWS; n++)
+            {
+                const auto value = static_cast<float>(re.Rand(-3.0, 3.0));
+                data.DataX(x)[n] = static_cast<T>(value);
+                const auto r = storage == Storage::Fp16 ? Srl::Utils::HalfToFloat(Srl::Utils::FloatToHalf(value))
+                                                        : (storage == Storage::Bf16 ? Srl::Utils::Bf16ToFloat(Srl::Utils::FloatToBf16(value)) : value);
+                rounded.DataX(x)[n] = static_cast<T>(r);
+            }
+        }
+        for (size_t n = 0; n < ROWS; n++)
+            data.DataY()[n] = static_cast<T>(re.Rand(-3.0, 3.0));
+        data.Compact(storage);
+
+        std::vector<size_t> selection(ROWS / BATCH);
+        std::iota(selection.begin(), selection.end(), 0);
+        for (auto isa : {Isa::Sse42, Isa::Avx2, Isa::Avx512})
+        {
+            if (Srl::Utils::SelectIsa(isa) != isa)
+                continue;
+            Srl::Computer::Machine<T, BATCH> machine{cs, isa};
+
+            machine.Compute(rounded, code, 0, T{}, T{}, selection.size());
+            double expected = 0.0;
+            for (const auto b : selection)
+                expected += Srl::Utils::ComputeSqErr<T, false>(data.BatchY(b), rounded.BatchY(b), BATCH);
+            expected /= ROWS;
+
+            Srl::Utils::Result<BATCH> r;
+            machine.ComputeScore(data, code, selection, r, 0, 0, T{}, T{}, T{1}, T{1});
+            const auto tolerance = std::is_same_v<T, float> ? 1e-5 : 1e-12;
+            Check(std::abs(r.Mean() - expected) <= tolerance * expected, "compact score", r.Mean() - expected);
+        }
+    }
+}
+
+int main(int /*argc*/, char * /*argv*/[])
+{
+    TestConversions();
+    TestWiden<float>();
+    TestWiden<double>();
+    TestCompactScore<float>();
+    TestCompactScore<double>();
+
+    std::cout << (failures ? "FAILED" : "OK") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+// g++ -std=c++20 -O2 -msse4.2 -mpopcnt -fno-exceptions shared_code_test.cpp -o shared_code_test -lpthread
+#include <iostream>
+
+#include "../../SymbolicRegression/SymbolicRegression.h"
+
+namespace Srl = SymbolicRegression;
+using SharedCode = Srl::HillClimb::SharedCode<double>;
+using EvaluatedCode = Srl::EvaluatedCode<double>;
+
+constexpr Srl::CodeSettings CS{4, 8, 1, 32};
+constexpr uint32_t PUBLISHES = 2000000;
+constexpr size_t READERS = 3;
+
+// every field of the k-th code is derived from k, so a torn copy mixes two of them
+void MakeCode(EvaluatedCode &evc, uint32_t k)
+{
+    auto &code = evc.mCode;
+    code.mCodeSize = 1 + k % CS.mMaxCodeSize;
+    for (uint32_t i = 0; i < code.mCodeSize; i++)
+    {
+        auto &instr = code.mCodeInstructions[i];
+        instr.mOpCode = static_cast<Srl::Computer::Instructions::InstructionID>(k % 7);
+        instr.mSrc[0] = k;
+        instr.mSrc[1] = k + i;
+        instr.mConst[0] = k & 1;
+        instr.mConst[1] = !(k & 1);
+    }
+    for (size_t i = 0; i < code.mConstants.size(); i++)
+    {
+        code.mConstants[i] = k + 0.5 * i;
+    }
+    for (size_t i = 0; i < 3; i++)
+    {
+        evc.mScore[i] = (i + 1.0) * k;
+    }
+}
+
+bool Consistent(const EvaluatedCode &evc)
+{
+    const auto &code = evc.mCode;
+    const auto k = static_cast<uint32_t>(evc.mScore[0]);
+    if (code.mCodeSize != 1 + k % CS.mMaxCodeSize || evc.mScore[1] != 2.0 * k || evc.mScore[2] != 3.0 * k)
+        return false;
+    for (uint32_t i = 0; i < code.mCodeSize; i++)
+    {
+        const auto &instr = code.mCodeInstructions[i];
+        if (instr.mOpCode != static_cast<Srl::Computer::Instructions::InstructionID>(k % 7) || instr.mSrc[0] != k ||
+            instr.mSrc[1] != k + i || instr.mConst[0] != bool(k & 1) || instr.mConst[1] != !(k & 1))
+            return false;
+    }
+    for (size_t i = 0; i < code.mConstants.size(); i++)
+    {
+        if (code.mConstants[i] != k + 0.5 * i)
+            return false;
+    }
+    return true;
+}
+
+int main(int /*argc*/, char * /*argv*/[])
+{
+    SharedCode shared{CS};
+    int failures = 0;
+
+    EvaluatedCode evc{CS};
+    uint64_t sequence = 0;
+    if (!shared.Empty() || shared.Read(evc, sequence) || shared.Scores()[0] != LARGE_FLOAT)
+    {
+        std::cout << "FAIL: a code before the first publish" << std::endl;
+        failures++;
+    }
+
+    // readers copy the code and its scores while the writer keeps publishing, every copy must be whole and
+    // no older than the one before
+    std::atomic<bool> done{false};
+    std::atomic<int> torn{0}, stale{0};
+    std::vector<std::thread> readers;
+    for (size_t r = 0; r < READERS; r++)
+    {
+        readers.emplace_back([&]()
+                             {
+            EvaluatedCode copy{CS};
+            uint64_t seq = 0;
+            double last = 0;
+            while (!done.load(std::memory_order_acquire))
+            {
+                if (shared.Read(copy, seq))
+                {
+                    if (!Consistent(copy))
+                        torn++;
+                    if (copy.mScore[0] < last)
+                        stale++;
+                    last = copy.mScore[0];
+                }
+                const auto scores = shared.Scores();
+                if (scores[0] != LARGE_FLOAT && (scores[1] != 2 * scores[0] || scores[2] != 3 * scores[0]))
+                    torn++;
+            } });
+    }
+    EvaluatedCode published{CS};
+    for (uint32_t k = 1; k <= PUBLISHES; k++)
+    {
+        MakeCode(published, k);
+        shared.Publish(published);
+    }
+    done.store(true, std::memory_order_release);
+    for (auto &t : readers)
+    {
+        t.join();
+    }
+    if (torn || stale)
+    {
+        std::cout << "FAIL: " << torn << " torn and " << stale << " stale reads" << std::endl;
+        failures++;
+    }
+
+    // the last code is read once, then not again until the next publish
+    if (!shared.Read(evc, sequence) || !Consistent(evc) || evc.mScore[0] != PUBLISHES || shared.Read(evc, sequence))
+    {
+        std::cout << "FAIL: last publish not read once" << std::endl;
+        failures++;
+    }
+
+    std::cout << (failures ? "FAILED" : "OK") << std::endl;
+    return failures;
+}